@@ -0,0 +1,271 @@
+/* C Program: the benchmark of the pipeline (./symnmf bench output.json, or make bench).
+At every scale of BENCH_SCALES, synthetic Gaussian clusters go through sym, ddg, norm, one W*H and BENCH_ITERATIONS
+iterations of the update, each stage timed as the best of BENCH_REPEATS runs. The work of a stage is counted by a
+model: its floating point operations (an exp counts as one), and the bytes it has to move at least, every input read
+once and every output written once. The rates are the model over the time, so two builds of the same tree compare
+by the time of the same work, and the JSON of one run can be diffed against another. */
+#include "symnmf.h"
+
+/* Runs per stage, the fastest one counts */
+#define BENCH_REPEATS (3)
+/* The symnmf stage runs exactly this many iterations (epsilon 0), so it does the same work on every build */
+#define BENCH_ITERATIONS (50)
+#define BENCH_SEED (0)
+/* The cluster centers are drawn from U[-BENCH_CENTER_RANGE, BENCH_CENTER_RANGE) in every dimension */
+#define BENCH_CENTER_RANGE (5.0)
+
+/* n, d and k of every scale */
+static const int BENCH_SCALES[][3] = { { 1000, 4, 4 }, { 2000, 8, 8 }, { 3000, 16, 12 } };
+static const char* BENCH_STAGE_NAMES[BENCH_STAGE_COUNT] = { "sym", "ddg", "norm", "mat_mult", "symnmf" };
+
+int gaussian_clusters(int n, int d, int k, unsigned long seed, PMATRIX* ppoints)
+{
+    /* Point i is around center i % k, the normal noise is drawn by Box-Muller */
+    int status = -1;
+    int i, c = 0;
+    double radius = 0;
+    RANDOM_STATE state;
+    PMATRIX centers = NULL;
+    PMATRIX points = NULL;
+
+    if (create_matrix(k, d, &centers) != 0 || create_matrix(n, d, &points) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    (void)seed_random(&state, seed);
+    for (i = 0; i < k; i++)
+        for (c = 0; c < d; c++)
+            MAT_AT(centers, i, c) = (REAL)(BENCH_CENTER_RANGE * (2 * next_random_double(&state) - 1));
+
+    for (i = 0; i < n; i++)
+        for (c = 0; c < d; c++)
+        {
+            radius = sqrt(-2 * log(1 - next_random_double(&state)));
+            MAT_AT(points, i, c) = (REAL)(MAT_AT(centers, i % k, c) + radius * cos(8 * atan(1) * next_random_double(&state)));
+        }
+
+    /* Transfer ownership */
+    *ppoints = points;
+    points = NULL;
+
+    status = 0;
+
+lblCleanup:
+    free_matrix(centers);
+    free_matrix(points);
+    return status;
+}
+
+static void free_bench_state(PBENCH_STATE state)
+{
+    free_matrix(state->points);
+    free_matrix(state->sim);
+    free_matrix(state->diagonal);
+    free_matrix(state->normalized);
+    free_matrix(state->initial_h);
+    free_matrix(state->product);
+    free_matrix(state->updated_h);
+    (void)memset(state, 0, sizeof(*state));
+}
+
+static int run_stage(BENCH_STAGE stage, PBENCH_STATE state, double* pseconds)
+{
+    /* One run of the stage, replacing its last output. Only the call itself is timed */
+    int status = -1;
+    double start = 0;
+    PMATRIX initial_h = NULL;
+    SYMNMF_PARAMS params;
+    W_OPERATOR op;
+
+    if (stage == BENCH_SYMNMF)
+    {
+        /* The solver takes H_0, so every run gets a copy */
+        if (create_matrix(state->n, state->k, &initial_h) != 0)
+        {
+            printf("An Error Has Occurred\n");
+            return 1;
+        }
+        (void)memcpy(initial_h->data, state->initial_h->data,
+            (size_t)state->n * (size_t)initial_h->stride * sizeof(REAL));
+        (void)dense_operator(state->normalized, &op);
+        (void)default_params(&params);
+        params.epsilon = 0;
+        params.max_iter = BENCH_ITERATIONS;
+    }
+
+    start = get_wall_time();
+    switch (stage)
+    {
+    case BENCH_SYM:
+        free_matrix(state->sim);
+        state->sim = NULL;
+        status = sym(state->points, &state->sim);
+        break;
+    case BENCH_DDG:
+        free_matrix(state->diagonal);
+        state->diagonal = NULL;
+        status = ddg(state->sim, &state->diagonal);
+        break;
+    case BENCH_NORM:
+        free_matrix(state->normalized);
+        state->normalized = NULL;
+        status = norm(state->sim, state->diagonal, &state->normalized);
+        break;
+    case BENCH_MAT_MULT:
+        free_matrix(state->product);
+        state->product = NULL;
+        status = mat_mult(state->normalized, state->initial_h, &state->product);
+        break;
+    default:
+        free_matrix(state->updated_h);
+        state->updated_h = NULL;
+        status = symnmf_solve_with(&op, initial_h, &params, &state->updated_h, &state->report);
+        break;
+    }
+    *pseconds = get_wall_time() - start;
+
+    if (status != 0)
+        printf("An Error Has Occurred\n");
+    return status;
+}
+
+static void stage_cost(BENCH_STAGE stage, PBENCH_STATE state, double* pflops, double* pbytes)
+{
+    /* The model of the work of a stage (see above) */
+    double n = state->n;
+    double d = state->d;
+    double k = state->k;
+    double element = sizeof(REAL);
+
+    switch (stage)
+    {
+    case BENCH_SYM:
+        /* Every pair once: d differences, squares and sums, the scale and the exp */
+        *pflops = n * (n - 1) / 2 * (3 * d + 2);
+        *pbytes = (n * d + n * n) * element;
+        break;
+    case BENCH_DDG:
+        *pflops = n * n;
+        *pbytes = 2 * n * n * element;
+        break;
+    case BENCH_NORM:
+        /* The diagonal of D is all it reads of D */
+        *pflops = 2 * n * n;
+        *pbytes = (2 * n * n + n) * element;
+        break;
+    case BENCH_MAT_MULT:
+        *pflops = 2 * n * n * k;
+        *pbytes = (n * n + 2 * n * k) * element;
+        break;
+    default:
+        /* Per iteration: W*H, H^T*H, H*(H^T*H) and the update of every entry */
+        *pflops = state->report.iterations * (2 * n * n * k + 4 * n * k * k + 5 * n * k);
+        *pbytes = state->report.iterations * (n * n + 3 * n * k) * element;
+        break;
+    }
+}
+
+static int run_scale(int n, int d, int k, FILE* json, int first)
+{
+    /* Every stage at one scale: a line per stage on stdout, and a JSON object per stage */
+    int status = -1;
+    int stage, repeat = 0;
+    double seconds, best = 0;
+    double flops, bytes = 0;
+    BENCH_STATE state;
+    W_OPERATOR op;
+
+    (void)memset(&state, 0, sizeof(state));
+    state.n = n;
+    state.d = d;
+    state.k = k;
+
+    status = gaussian_clusters(n, d, k, BENCH_SEED, &state.points);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    for (stage = 0; stage < BENCH_STAGE_COUNT; stage++)
+    {
+        /* H_0 like symnmf_fit, from the W of the norm stage */
+        if (stage == BENCH_MAT_MULT)
+        {
+            (void)dense_operator(state.normalized, &op);
+            status = initialize_h(&op, n, k, BENCH_SEED, &state.initial_h);
+            if (status != 0)
+            {
+                printf("An Error Has Occurred\n");
+                goto lblCleanup;
+            }
+        }
+
+        best = HUGE_VAL;
+        for (repeat = 0; repeat < BENCH_REPEATS; repeat++)
+        {
+            status = run_stage((BENCH_STAGE)stage, &state, &seconds);
+            if (status != 0)
+            {
+                printf("An Error Has Occurred\n");
+                goto lblCleanup;
+            }
+            if (seconds < best)
+                best = seconds;
+        }
+
+        (void)stage_cost((BENCH_STAGE)stage, &state, &flops, &bytes);
+        printf("n=%-6d d=%-3d k=%-3d %-8s %10.4f s %8.2f GFLOP/s %8.2f GB/s\n", n, d, k, BENCH_STAGE_NAMES[stage],
+            best, flops / best / 1e9, bytes / best / 1e9);
+        fprintf(json, "%s    {\"n\": %d, \"d\": %d, \"k\": %d, \"stage\": \"%s\", \"seconds\": %.9g, \"flops\": %.9g, "
+            "\"bytes\": %.9g, \"gflops_per_second\": %.6g, \"gbytes_per_second\": %.6g", (first && stage == 0) ? "" : ",\n",
+            n, d, k, BENCH_STAGE_NAMES[stage], best, flops, bytes, flops / best / 1e9, bytes / best / 1e9);
+        if (stage == BENCH_SYMNMF)
+            fprintf(json, ", \"iterations\": %d", state.report.iterations);
+        fprintf(json, "}");
+    }
+
+    status = 0;
+
+lblCleanup:
+    (void)free_bench_state(&state);
+    return status;
+}
+
+int run_benchmark(char* json_file_name)
+{
+    int status = -1;
+    int scale = 0;
+    FILE* json = NULL;
+
+    json = fopen(json_file_name, "w");
+    if (json == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    fprintf(json, "{\n  \"precision\": \"%s\",\n  \"threads\": %d,\n  \"repeats\": %d,\n  \"results\": [\n",
+        (sizeof(REAL) == sizeof(float)) ? "float32" : "float64", get_thread_count(), BENCH_REPEATS);
+    for (scale = 0; scale < (int)(sizeof(BENCH_SCALES) / sizeof(BENCH_SCALES[0])); scale++)
+    {
+        status = run_scale(BENCH_SCALES[scale][0], BENCH_SCALES[scale][1], BENCH_SCALES[scale][2], json, scale == 0);
+        if (status != 0)
+        {
+            printf("An Error Has Occurred\n");
+            goto lblCleanup;
+        }
+    }
+    fprintf(json, "\n  ]\n}\n");
+
+    status = 0;
+
+lblCleanup:
+    if (json != NULL)
+        fclose(json);
+    return status;
+}
@@ -0,0 +1,303 @@
+/* C Program: the blocked matrix multiplication engine used by symnmf.c.
+Follows the classic GotoBLAS layering: B is packed once per (KC x NC) block so it stays in L2/L3,
+A is packed per (MC x KC) block so it stays in L2, and a register-tiled MR x NR micro-kernel
+streams both packed panels from L1.
+The kernels specialized for the skinny shapes of the SymNMF update (k is small) live here as well. */
+#include "symnmf.h"
+
+#define PACKED_A_SIZE ((size_t)GEMM_MC * GEMM_KC)
+#define PACKED_B_SIZE ((size_t)GEMM_KC * GEMM_NC)
+/* Columns of a row of C that mult_small sums at once, in double on the stack */
+#define SMALL_COLUMNS (64)
+
+/* The micro-kernel is cloned for the widest vector ISA available at runtime, the loader picks the clone */
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(GEMM_NO_CLONES)
+#define GEMM_KERNEL_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define GEMM_KERNEL_CLONES
+#endif
+
+static void pack_a(PMATRIX A, int ic, int pc, int mc, int kc, REAL* packed)
+{
+    /* Packs A[ic:ic+mc, pc:pc+kc] as consecutive MR-row panels, each stored column by column.
+    The last panel is padded with zeros, so the micro-kernel never needs to check bounds */
+    int ir, i, p = 0;
+    int mr = 0;
+    REAL* row = NULL;
+
+    for (ir = 0; ir < mc; ir += GEMM_MR)
+    {
+        mr = (mc - ir < GEMM_MR) ? (mc - ir) : GEMM_MR;
+        for (i = 0; i < GEMM_MR; i++)
+        {
+            if (i < mr)
+            {
+                row = MAT_ROW(A, ic + ir + i) + pc;
+                for (p = 0; p < kc; p++)
+                    packed[p * GEMM_MR + i] = row[p];
+            }
+            else
+            {
+                for (p = 0; p < kc; p++)
+                    packed[p * GEMM_MR + i] = 0;
+            }
+        }
+        packed += (size_t)kc * GEMM_MR;
+    }
+}
+
+static void pack_b(PMATRIX B, int pc, int jc, int kc, int nc, REAL* packed)
+{
+    /* Packs B[pc:pc+kc, jc:jc+nc] as consecutive NR-column panels, each stored row by row.
+    The last panel is padded with zeros */
+    int jr, j, p = 0;
+    int nr = 0;
+    REAL* row = NULL;
+
+    for (jr = 0; jr < nc; jr += GEMM_NR)
+    {
+        nr = (nc - jr < GEMM_NR) ? (nc - jr) : GEMM_NR;
+        for (p = 0; p < kc; p++)
+        {
+            row = MAT_ROW(B, pc + p) + jc + jr;
+            for (j = 0; j < nr; j++)
+                packed[p * GEMM_NR + j] = row[j];
+            for (; j < GEMM_NR; j++)
+                packed[p * GEMM_NR + j] = 0;
+        }
+        packed += (size_t)kc * GEMM_NR;
+    }
+}
+
+GEMM_KERNEL_CLONES
+static void micro_kernel(int kc, const REAL* a, const REAL* b, REAL* c, int ldc, int mr, int nr)
+{
+    /* c[0:mr, 0:nr] += (MR x kc panel a) * (kc x NR panel b).
+    The accumulator tile has compile-time dimensions, so it is fully unrolled and kept in vector registers.
+    It is double for either element type, so a single precision panel is still summed in double */
+    double acc[GEMM_MR * GEMM_NR];
+    int i, j, p = 0;
+
+    for (i = 0; i < GEMM_MR * GEMM_NR; i++)
+        acc[i] = 0;
+
+    for (p = 0; p < kc; p++)
+    {
+        for (i = 0; i < GEMM_MR; i++)
+            for (j = 0; j < GEMM_NR; j++)
+                acc[i * GEMM_NR + j] += (double)a[i] * b[j];
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+    for (i = 0; i < mr; i++)
+        for (j = 0; j < nr; j++)
+            c[(size_t)i * ldc + j] += acc[i * GEMM_NR + j];
+}
+
+static void gemm_block(PMATRIX A, PMATRIX C, int ic, int mc, int pc, int kc, int jc, int nc, REAL* packed_a, const REAL* packed_b)
+{
+    /* C[ic:ic+mc, jc:jc+nc] += A[ic:ic+mc, pc:pc+kc] * (the packed block of B) */
+    int jr, ir = 0;
+
+    (void)pack_a(A, ic, pc, mc, kc, packed_a);
+
+    for (jr = 0; jr < nc; jr += GEMM_NR)
+        for (ir = 0; ir < mc; ir += GEMM_MR)
+            (void)micro_kernel(kc,
+                packed_a + (size_t)ir * kc,
+                packed_b + (size_t)jr * kc,
+                MAT_ROW(C, ic + ir) + jc + jr,
+                C->stride,
+                (mc - ir < GEMM_MR) ? (mc - ir) : GEMM_MR,
+                (nc - jr < GEMM_NR) ? (nc - jr) : GEMM_NR);
+}
+
+int create_gemm_workspace(PGEMM_WORKSPACE* pworkspace)
+{
+    int status = -1;
+    PGEMM_WORKSPACE workspace = NULL;
+
+    workspace = (PGEMM_WORKSPACE)HEAPALLOCZ(workspace, 1);
+    if (workspace == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* Every thread packs its own blocks of A, while the packed block of B is shared */
+    workspace->threads = get_thread_count();
+    workspace->packed_a = (REAL*)heap_alloc_aligned(PACKED_A_SIZE * (size_t)workspace->threads * sizeof(REAL));
+    workspace->packed_b = (REAL*)heap_alloc_aligned(PACKED_B_SIZE * sizeof(REAL));
+    if (workspace->packed_a == NULL || workspace->packed_b == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* Transfer ownership */
+    *pworkspace = workspace;
+    workspace = NULL;
+
+    status = 0;
+
+lblCleanup:
+    free_gemm_workspace(workspace);
+    return status;
+}
+
+void free_gemm_workspace(PGEMM_WORKSPACE workspace)
+{
+    if (workspace != NULL)
+    {
+        HEAPFREE(workspace->packed_a);
+        HEAPFREE(workspace->packed_b);
+        HEAPFREE(workspace);
+    }
+}
+
+int gemm(PMATRIX A, PMATRIX B, PMATRIX C, PGEMM_WORKSPACE workspace)
+{
+    int status = -1;
+    int n, k, m = 0;
+    int jc, pc, ic = 0;
+    int nc, kc = 0;
+    int i = 0;
+    REAL* packed_b = NULL;
+    PGEMM_WORKSPACE own_workspace = NULL;
+
+    n = A->rows;
+    k = A->cols;
+    m = B->cols;
+
+    /* Use a temporary workspace if the caller didn't supply one */
+    if (workspace == NULL)
+    {
+        status = create_gemm_workspace(&own_workspace);
+        if (status != 0)
+        {
+            printf("An Error Has Occurred\n");
+            status = 1;
+            goto lblCleanup;
+        }
+        workspace = own_workspace;
+    }
+    packed_b = workspace->packed_b;
+
+    /* The micro-kernel accumulates, so start from C = 0 - with the same row partition as below,
+    so on NUMA machines the rows of C are touched by the thread that computes them */
+#pragma omp parallel for schedule(static) num_threads(workspace->threads)
+    for (i = 0; i < n; i++)
+        (void)memset(MAT_ROW(C, i), 0, (size_t)m * sizeof(REAL));
+
+    for (jc = 0; jc < m; jc += GEMM_NC)
+    {
+        nc = (m - jc < GEMM_NC) ? (m - jc) : GEMM_NC;
+        for (pc = 0; pc < k; pc += GEMM_KC)
+        {
+            kc = (k - pc < GEMM_KC) ? (k - pc) : GEMM_KC;
+            (void)pack_b(B, pc, jc, kc, nc, packed_b);
+
+            /* The row blocks of A and C are split between the threads */
+#pragma omp parallel for schedule(static) num_threads(workspace->threads)
+            for (ic = 0; ic < n; ic += GEMM_MC)
+                (void)gemm_block(A, C, ic, (n - ic < GEMM_MC) ? (n - ic) : GEMM_MC, pc, kc, jc, nc,
+                    workspace->packed_a + PACKED_A_SIZE * (size_t)get_thread_index(), packed_b);
+        }
+    }
+
+    status = 0;
+
+lblCleanup:
+    free_gemm_workspace(own_workspace);
+    return status;
+}
+
+GEMM_KERNEL_CLONES
+int gram(PMATRIX H, PMATRIX G)
+{
+    /* G = H^T * H as a sum of the rank-1 updates h_i^T * h_i over the rows of H, so H is read once,
+    row by row, and never transposed. Only the upper triangle is accumulated (in double, over all n rows),
+    then mirrored */
+    int i, a, b = 0;
+    int n, k = 0;
+    double h_a = 0;
+    double* g = NULL;
+    double* g_row = NULL;
+    REAL* h_row = NULL;
+
+    n = H->rows;
+    k = H->cols;
+
+    g = (double*)HEAPALLOCZ(g, (size_t)k * (size_t)k + 1);
+    if (g == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+
+    /* The rows are split between the threads, each summing into a private copy of G */
+#pragma omp parallel for schedule(static) private(a, b, h_a, h_row, g_row) reduction(+:g[:k * k])
+    for (i = 0; i < n; i++)
+    {
+        h_row = MAT_ROW(H, i);
+        for (a = 0; a < k; a++)
+        {
+            h_a = h_row[a];
+            g_row = g + (size_t)a * k;
+            for (b = a; b < k; b++)
+                g_row[b] += h_a * h_row[b];
+        }
+    }
+
+    for (a = 0; a < k; a++)
+        for (b = a; b < k; b++)
+            MAT_AT(G, a, b) = MAT_AT(G, b, a) = (REAL)g[(size_t)a * k + b];
+
+    HEAPFREE(g);
+    return 0;
+}
+
+GEMM_KERNEL_CLONES
+void mult_small(PMATRIX A, PMATRIX B, PMATRIX C)
+{
+    /* C = A * B for a tall A (nXk) and a small B (kXk): the packing of the blocked engine doesn't pay off
+    for such shapes, while B fits in L1 and each row of C is a combination of its rows.
+    The k terms of every entry are summed in double (SMALL_COLUMNS of a row at a time) and rounded once on store */
+    int i, j, x = 0;
+    int n, k, m = 0;
+    int j0, width = 0;
+    double a_ix = 0;
+    double sums[SMALL_COLUMNS];
+    REAL* a_row = NULL;
+    REAL* b_row = NULL;
+    REAL* c_row = NULL;
+
+    n = A->rows;
+    k = A->cols;
+    m = B->cols;
+
+#pragma omp parallel for schedule(static) private(j, x, j0, width, a_ix, sums, a_row, b_row, c_row)
+    for (i = 0; i < n; i++)
+    {
+        a_row = MAT_ROW(A, i);
+        c_row = MAT_ROW(C, i);
+        for (j0 = 0; j0 < m; j0 += SMALL_COLUMNS)
+        {
+            width = (m - j0 < SMALL_COLUMNS) ? m - j0 : SMALL_COLUMNS;
+            for (j = 0; j < width; j++)
+                sums[j] = 0;
+            for (x = 0; x < k; x++)
+            {
+                a_ix = a_row[x];
+                b_row = MAT_ROW(B, x) + j0;
+                for (j = 0; j < width; j++)
+                    sums[j] += a_ix * b_row[j];
+            }
+            for (j = 0; j < width; j++)
+                c_row[j0 + j] = (REAL)sums[j];
+        }
+    }
+}
@@ -0,0 +1,322 @@
+/* C Program: the K-means of the analysis (kmeans.py), on a contiguous array of points.
+Lloyd's iterations, with the rules of kmeans.py so both give the same clusters: the distances are summed coordinate
+by coordinate, a point goes to the first of its closest centroids, and a centroid is the sum of its points divided by
+their count (an empty cluster keeps its centroid). kmeans.py sums the points of a cluster in the order they joined it
+(cluster.points), and this one in index order, so the centroids may differ in the last bits; tests/test_kmeans.py
+checks the labels and iteration counts against the loop of kmeans.py. It stops once no centroid moved by
+KMEANS_EPSILON or more, or after KMEANS_MAX_ITER iterations.
+Most distances are never computed (Hamerly): every point keeps an upper bound u on the distance to its centroid and
+a lower bound l on the distance to any other one. When u is below l, or below half the distance from its centroid to
+the closest other centroid, the point can't move. Moving centroids loosen the bounds by how much they moved. */
+#include "symnmf.h"
+
+static double distance(const REAL* point, const REAL* centroid, int d)
+{
+    /* The euclidean distance, summed in the order of kmeans.py */
+    int c = 0;
+    double diff = 0;
+    double total = 0;
+
+    for (c = 0; c < d; c++)
+    {
+        diff = (double)point[c] - centroid[c];
+        total += diff * diff;
+    }
+    return sqrt(total);
+}
+
+static int closest_two(const REAL* point, PMATRIX centroids_t, double* distances, double* pnearest, double* psecond)
+{
+    /* The index of the first closest centroid, its distance and the distance to the closest other one.
+    The centroids are transposed (dXk), so the inner loop runs over them and vectorizes, and every distance
+    is still summed over the coords in order (the same value as distance) */
+    int j, c = 0;
+    int k = centroids_t->cols;
+    int label = 0;
+    double diff = 0;
+    double nearest = HUGE_VAL;
+    double second = HUGE_VAL;
+    REAL* coords = NULL;
+
+    for (j = 0; j < k; j++)
+        distances[j] = 0;
+    for (c = 0; c < centroids_t->rows; c++)
+    {
+        coords = MAT_ROW(centroids_t, c);
+        for (j = 0; j < k; j++)
+        {
+            diff = (double)point[c] - coords[j];
+            distances[j] += diff * diff;
+        }
+    }
+
+    for (j = 0; j < k; j++)
+    {
+        distances[j] = sqrt(distances[j]);
+        if (distances[j] < nearest)
+        {
+            second = nearest;
+            nearest = distances[j];
+            label = j;
+        }
+        else if (distances[j] < second)
+            second = distances[j];
+    }
+
+    *pnearest = nearest;
+    *psecond = second;
+    return label;
+}
+
+static int init_plus_plus(PMATRIX points, int k, unsigned long seed, PMATRIX centroids)
+{
+    /* k-means++: the first centroid is a uniformly drawn point, every next one a point drawn with probability
+    proportional to its squared distance to the closest centroid so far */
+    int i, j = 0;
+    int n = points->rows;
+    int chosen = 0;
+    double dist = 0;
+    double total = 0;
+    double target = 0;
+    double* nearest = NULL;
+    RANDOM_STATE state;
+
+    nearest = (double*)HEAPALLOCZ(nearest, (size_t)n);
+    if (nearest == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+
+    (void)seed_random(&state, seed);
+    chosen = (int)(next_random_double(&state) * n);
+    (void)memcpy(MAT_ROW(centroids, 0), MAT_ROW(points, chosen), (size_t)points->cols * sizeof(REAL));
+
+    for (j = 1; j < k; j++)
+    {
+        total = 0;
+#pragma omp parallel for schedule(static) private(dist) reduction(+:total)
+        for (i = 0; i < n; i++)
+        {
+            dist = distance(MAT_ROW(points, i), MAT_ROW(centroids, j - 1), points->cols);
+            if (j == 1 || dist * dist < nearest[i])
+                nearest[i] = dist * dist;
+            total += nearest[i];
+        }
+
+        /* The first point whose cumulative weight passes the target (the last one against rounding) */
+        target = next_random_double(&state) * total;
+        for (chosen = 0; chosen < n - 1 && target >= nearest[chosen]; chosen++)
+            target -= nearest[chosen];
+        (void)memcpy(MAT_ROW(centroids, j), MAT_ROW(points, chosen), (size_t)points->cols * sizeof(REAL));
+    }
+
+    HEAPFREE(nearest);
+    return 0;
+}
+
+static int update_centroids(PMATRIX points, int* labels, PMATRIX centroids, PMATRIX centroids_t, double* moves)
+{
+    /* The means of the clusters, summed over the points in index order, into centroids and centroids_t.
+    moves gets how far every centroid moved */
+    int i, j, c = 0;
+    int n = points->rows;
+    int k = centroids->rows;
+    int d = points->cols;
+    int* sizes = NULL;
+    double diff = 0;
+    double* sums = NULL;
+    double* mean = NULL;
+
+    sizes = (int*)HEAPALLOCZ(sizes, (size_t)k);
+    sums = (double*)HEAPALLOCZ(sums, (size_t)k * (size_t)d);
+    if (sizes == NULL || sums == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        HEAPFREE(sizes);
+        HEAPFREE(sums);
+        return 1;
+    }
+
+    for (i = 0; i < n; i++)
+        sizes[labels[i]]++;
+
+    /* Every coord is summed by one thread, over the points in order */
+#pragma omp parallel for schedule(static) private(i)
+    for (c = 0; c < d; c++)
+        for (i = 0; i < n; i++)
+            sums[(size_t)labels[i] * (size_t)d + (size_t)c] += MAT_AT(points, i, c);
+
+    for (j = 0; j < k; j++)
+    {
+        moves[j] = 0;
+        if (sizes[j] == 0)
+            continue;
+        mean = sums + (size_t)j * (size_t)d;
+        for (c = 0; c < d; c++)
+        {
+            mean[c] /= sizes[j];
+            diff = MAT_AT(centroids, j, c) - mean[c];
+            moves[j] += diff * diff;
+            MAT_AT(centroids, j, c) = (REAL)mean[c];
+            MAT_AT(centroids_t, c, j) = (REAL)mean[c];
+        }
+        moves[j] = sqrt(moves[j]);
+    }
+
+    HEAPFREE(sizes);
+    HEAPFREE(sums);
+    return 0;
+}
+
+int kmeans(PMATRIX points, int k, KMEANS_INIT init, unsigned long seed, int* labels, PMATRIX* pcentroids, int* piterations)
+{
+    /* labels gets the cluster of every point. pcentroids and piterations may be NULL */
+    int status = -1;
+    int i, j, l, t = 0;
+    int n = points->rows;
+    int d = points->cols;
+    int threads = get_thread_count();
+    int iteration = 0;
+    int convergence = 0; /* initialized to False */
+    int farthest = 0;
+    double largest, runner_up = 0;
+    double gap = 0;
+    double bound = 0;
+    double* upper = NULL; /* per point: at least the distance to its centroid */
+    double* lower = NULL; /* per point: at most the distance to any other centroid */
+    double* half_gaps = NULL; /* per centroid: half the distance to the closest other one */
+    double* moves = NULL;
+    double* distances = NULL; /* per thread: the distances of a point to every centroid */
+    PMATRIX centroids = NULL;
+    PMATRIX centroids_t = NULL;
+
+    if (k < 1 || k > n || (int)init < 0 || init >= KMEANS_INIT_COUNT)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    upper = (double*)HEAPALLOCZ(upper, (size_t)n);
+    lower = (double*)HEAPALLOCZ(lower, (size_t)n);
+    half_gaps = (double*)HEAPALLOCZ(half_gaps, (size_t)k);
+    moves = (double*)HEAPALLOCZ(moves, (size_t)k);
+    distances = (double*)HEAPALLOCZ(distances, (size_t)threads * (size_t)k);
+    if (upper == NULL || lower == NULL || half_gaps == NULL || moves == NULL || distances == NULL ||
+        create_matrix(k, d, &centroids) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* The initial centroids: the first k points (like the analysis), or k-means++ */
+    if (init == KMEANS_INIT_FIRST)
+        for (j = 0; j < k; j++)
+            (void)memcpy(MAT_ROW(centroids, j), MAT_ROW(points, j), (size_t)d * sizeof(REAL));
+    else if (init_plus_plus(points, k, seed, centroids) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    status = transpose_matrix(centroids, &centroids_t);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    while (!convergence && iteration < KMEANS_MAX_ITER)
+    {
+        if (iteration == 0)
+        {
+            /* The first assignment computes every distance, and sets the bounds */
+#pragma omp parallel for schedule(static) num_threads(threads) private(t)
+            for (i = 0; i < n; i++)
+            {
+                t = get_thread_index();
+                labels[i] = closest_two(MAT_ROW(points, i), centroids_t, distances + (size_t)t * (size_t)k,
+                    &upper[i], &lower[i]);
+            }
+        }
+        else
+        {
+            for (j = 0; j < k; j++)
+            {
+                half_gaps[j] = HUGE_VAL;
+                for (l = 0; l < k; l++)
+                {
+                    gap = distance(MAT_ROW(centroids, j), MAT_ROW(centroids, l), d) / 2;
+                    if (l != j && gap < half_gaps[j])
+                        half_gaps[j] = gap;
+                }
+            }
+
+            /* The bounds are strict, so a point they keep in place has no tie to break */
+#pragma omp parallel for schedule(dynamic, 256) num_threads(threads) private(t, bound)
+            for (i = 0; i < n; i++)
+            {
+                bound = (half_gaps[labels[i]] > lower[i]) ? half_gaps[labels[i]] : lower[i];
+                if (upper[i] < bound)
+                    continue;
+                upper[i] = distance(MAT_ROW(points, i), MAT_ROW(centroids, labels[i]), d);
+                if (upper[i] < bound)
+                    continue;
+                t = get_thread_index();
+                labels[i] = closest_two(MAT_ROW(points, i), centroids_t, distances + (size_t)t * (size_t)k,
+                    &upper[i], &lower[i]);
+            }
+        }
+
+        status = update_centroids(points, labels, centroids, centroids_t, moves);
+        if (status != 0)
+        {
+            printf("An Error Has Occurred\n");
+            goto lblCleanup;
+        }
+
+        /* Loosen the bounds by the moves: no other centroid came closer than the farthest move among them */
+        farthest = 0;
+        for (j = 1; j < k; j++)
+            if (moves[j] > moves[farthest])
+                farthest = j;
+        largest = moves[farthest];
+        runner_up = 0;
+        for (j = 0; j < k; j++)
+            if (j != farthest && moves[j] > runner_up)
+                runner_up = moves[j];
+#pragma omp parallel for schedule(static)
+        for (i = 0; i < n; i++)
+        {
+            upper[i] += moves[labels[i]];
+            lower[i] -= (labels[i] == farthest) ? runner_up : largest;
+        }
+
+        convergence = (largest < KMEANS_EPSILON);
+        iteration++;
+    }
+
+    if (piterations != NULL)
+        *piterations = iteration;
+
+    /* Transfer ownership */
+    if (pcentroids != NULL)
+    {
+        *pcentroids = centroids;
+        centroids = NULL;
+    }
+
+    status = 0;
+
+lblCleanup:
+    HEAPFREE(upper);
+    HEAPFREE(lower);
+    HEAPFREE(half_gaps);
+    HEAPFREE(moves);
+    HEAPFREE(distances);
+    free_matrix(centroids);
+    free_matrix(centroids_t);
+    return status;
+}
@@ -0,0 +1,533 @@
+/* C Program: reading and writing the input matrices of symnmf.c.
+Besides the CSV text files, a matrix can be stored in a binary file: a MATRIX_FILE_HEADER followed by the rows,
+laid out exactly like a MATRIX in memory (padded to stride, native byte order). Such a file is mapped
+instead of parsed, so the points are used in place, without a copy. */
+#include "symnmf.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <limits.h>
+
+/* The CSV file is split into chunks of about this many bytes (cut at line ends), parsed by the threads */
+#define CSV_CHUNK_BYTES ((size_t)1 << 22)
+/* Tokens the fast path can't parse are copied (up to this length) and given to strtod */
+#define CSV_TOKEN_MAX (64)
+/* Up to 15 decimal digits the mantissa is exactly representable by a double */
+#define CSV_EXACT_DIGITS (15)
+#define CSV_EXACT_POWER (22)
+
+/* The powers of ten that are exactly representable by a double */
+static const double exact_powers_of_ten[CSV_EXACT_POWER + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* The rows a chunk holds before it has parsed anything, at least (it grows by doubling) */
+#define CSV_MIN_ROWS (16)
+
+/* The rows one chunk of the CSV file parsed so far, d values each */
+typedef struct _CSV_ROWS
+{
+    REAL* values;
+    size_t count;
+    size_t capacity;
+} CSV_ROWS;
+
+/* Zeros for the padding at the end of the rows */
+static const REAL row_padding[MATRIX_ALIGN_ELEMENTS] = { 0 };
+
+static size_t dtype_size(int dtype)
+{
+    if (dtype == MATRIX_DTYPE_FLOAT64)
+        return sizeof(double);
+    if (dtype == MATRIX_DTYPE_FLOAT32)
+        return sizeof(float);
+    return 0;
+}
+
+static int convert_mapped_rows(MATRIX_FILE_HEADER* header, const char* rows, PMATRIX* pmatrix)
+{
+    /* A file of the other precision is converted into a new matrix, it can't be used in place */
+    int status = -1;
+    int i, j = 0;
+    PMATRIX matrix = NULL;
+
+    status = create_matrix(header->rows, header->cols, &matrix);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    for (i = 0; i < header->rows; i++)
+        for (j = 0; j < header->cols; j++)
+            MAT_AT(matrix, i, j) = (header->dtype == MATRIX_DTYPE_FLOAT64) ?
+                (REAL)((const double*)rows)[(size_t)i * header->stride + j] :
+                (REAL)((const float*)rows)[(size_t)i * header->stride + j];
+
+    /* Transfer ownership */
+    *pmatrix = matrix;
+    matrix = NULL;
+
+    status = 0;
+
+lblCleanup:
+    free_matrix(matrix);
+    return status;
+}
+
+static int is_matrix_file(char* file_name)
+{
+    /* A binary matrix file starts with the magic, anything else is parsed as CSV */
+    char magic[MATRIX_FILE_MAGIC_SIZE];
+    FILE* fp = NULL;
+    int result = 0;
+
+    fp = fopen(file_name, "rb");
+    if (fp == NULL)
+        return 0;
+
+    if (fread(magic, 1, MATRIX_FILE_MAGIC_SIZE, fp) == MATRIX_FILE_MAGIC_SIZE)
+        result = (memcmp(magic, MATRIX_FILE_MAGIC, MATRIX_FILE_MAGIC_SIZE) == 0);
+
+    fclose(fp);
+    return result;
+}
+
+int map_matrix_file(char* file_name, PMATRIX* pmatrix)
+{
+    int status = -1;
+    int fd = -1;
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    size_t length = 0;
+    MATRIX_FILE_HEADER header;
+    PMATRIX matrix = NULL;
+
+    fd = open(file_name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(header))
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    length = (size_t)info.st_size;
+
+    /* A private writable mapping: the pages are shared with the page cache until written,
+    so a caller that modifies the matrix only ever changes its own copy */
+    mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* Validate the header against the file, the rows must be laid out like in create_matrix: aligned, or packed
+    when narrower than a cache line */
+    (void)memcpy(&header, mapping, sizeof(header));
+    if (memcmp(header.magic, MATRIX_FILE_MAGIC, MATRIX_FILE_MAGIC_SIZE) != 0 ||
+        header.version != MATRIX_FILE_VERSION || dtype_size(header.dtype) == 0 ||
+        header.rows < 0 || header.cols < 0 || header.stride < header.cols ||
+        (((size_t)header.stride * dtype_size(header.dtype)) % MATRIX_ALIGNMENT != 0 &&
+        (header.stride != header.cols || (size_t)header.cols * dtype_size(header.dtype) >= MATRIX_ALIGNMENT)) ||
+        length < sizeof(header) + (size_t)header.rows * (size_t)header.stride * dtype_size(header.dtype))
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    if (header.dtype != MATRIX_DTYPE_REAL)
+    {
+        status = convert_mapped_rows(&header, (char*)mapping + sizeof(header), pmatrix);
+        goto lblCleanup;
+    }
+
+    matrix = (PMATRIX)HEAPALLOCZ(matrix, 1);
+    if (matrix == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* The rows are used right where they are mapped */
+    matrix->data = (REAL*)((char*)mapping + sizeof(header));
+    matrix->rows = header.rows;
+    matrix->cols = header.cols;
+    matrix->stride = header.stride;
+    matrix->mapping = mapping;
+    matrix->mapping_length = length;
+    mapping = MAP_FAILED;
+
+    /* Transfer ownership */
+    *pmatrix = matrix;
+    matrix = NULL;
+
+    status = 0;
+
+lblCleanup:
+    if (mapping != MAP_FAILED)
+        (void)munmap(mapping, length);
+    if (fd >= 0)
+        (void)close(fd);
+    free_matrix(matrix);
+    return status;
+}
+
+void unmap_matrix(PMATRIX matrix)
+{
+    (void)munmap(matrix->mapping, matrix->mapping_length);
+    matrix->mapping = NULL;
+    matrix->data = NULL;
+}
+
+int save_matrix_file(char* file_name, PMATRIX matrix)
+{
+    int status = -1;
+    int i = 0;
+    FILE* fp = NULL;
+    MATRIX_FILE_HEADER header;
+
+    (void)memset(&header, 0, sizeof(header));
+    (void)memcpy(header.magic, MATRIX_FILE_MAGIC, MATRIX_FILE_MAGIC_SIZE);
+    header.version = MATRIX_FILE_VERSION;
+    header.dtype = MATRIX_DTYPE_REAL;
+    header.rows = matrix->rows;
+    header.cols = matrix->cols;
+    /* Always written with the stride of create_matrix, whatever the stride of the matrix in memory */
+    header.stride = MATRIX_STRIDE(matrix->cols);
+
+    fp = fopen(file_name, "wb");
+    if (fp == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    for (i = 0; i < matrix->rows; i++)
+    {
+        if (fwrite(MAT_ROW(matrix, i), sizeof(REAL), (size_t)matrix->cols, fp) != (size_t)matrix->cols ||
+            (header.stride > matrix->cols && fwrite(row_padding, sizeof(REAL), (size_t)(header.stride - matrix->cols), fp) != (size_t)(header.stride - matrix->cols)))
+        {
+            printf("An Error Has Occurred\n");
+            status = 1;
+            goto lblCleanup;
+        }
+    }
+
+    status = 0;
+
+lblCleanup:
+    if (fp != NULL && fclose(fp) != 0)
+        status = 1;
+    return status;
+}
+
+int load_matrix(char* file_name, PMATRIX* pmatrix)
+{
+    /* Binary files are mapped, anything else is parsed as CSV */
+    if (is_matrix_file(file_name))
+        return map_matrix_file(file_name, pmatrix);
+    return parse_csv_file(file_name, pmatrix);
+}
+
+static int is_csv_delimiter(const char* p, const char* end)
+{
+    return p == end || *p == ',' || *p == '\n' || *p == '\r';
+}
+
+static const char* parse_slow(const char* p, const char* end, double* pvalue)
+{
+    /* Copies the token so strtod never reads past the end of the mapping, the result is the one of atof */
+    char token[CSV_TOKEN_MAX];
+    size_t length = 0;
+
+    while (!is_csv_delimiter(p + length, end) && length < CSV_TOKEN_MAX - 1)
+    {
+        token[length] = p[length];
+        length++;
+    }
+    token[length] = '\0';
+    *pvalue = strtod(token, NULL);
+
+    /* Skip whatever strtod didn't use as well, up to the delimiter */
+    p += length;
+    while (!is_csv_delimiter(p, end))
+        p++;
+    return p;
+}
+
+static const char* parse_double(const char* p, const char* end, double* pvalue)
+{
+    /* [sign] digits [. digits] [e [sign] digits]. As long as the decimal mantissa and the power of ten
+    are both exact doubles, one multiplication or division is correctly rounded, so the value is the one
+    strtod returns. Any other token (too many digits, inf, nan, spaces) goes through strtod */
+    const char* start = p;
+    int negative = 0;
+    int digits = 0;
+    int exponent = 0;
+    int exponent_negative = 0;
+    int exponent_value = 0;
+    double mantissa = 0;
+
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        p++;
+    }
+
+    /* Leading zeros don't count as digits */
+    while (p < end && *p == '0')
+        p++;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+        mantissa = mantissa * 10 + (*p - '0');
+    if (p < end && *p == '.')
+    {
+        p++;
+        for (; p < end && *p >= '0' && *p <= '9'; p++, exponent--)
+        {
+            if (digits == 0 && *p == '0')
+                continue;
+            mantissa = mantissa * 10 + (*p - '0');
+            digits++;
+        }
+    }
+    if (p == start || (p == start + 1 && (*start == '-' || *start == '+' || *start == '.')))
+        return parse_slow(start, end, pvalue);
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            exponent_negative = (*p == '-');
+            p++;
+        }
+        if (p == end || *p < '0' || *p > '9')
+            return parse_slow(start, end, pvalue);
+        for (; p < end && *p >= '0' && *p <= '9' && exponent_value < 10000; p++)
+            exponent_value = exponent_value * 10 + (*p - '0');
+        exponent += exponent_negative ? -exponent_value : exponent_value;
+    }
+
+    if (!is_csv_delimiter(p, end) || digits > CSV_EXACT_DIGITS ||
+        exponent > CSV_EXACT_POWER || exponent < -CSV_EXACT_POWER)
+        return parse_slow(start, end, pvalue);
+
+    if (exponent >= 0)
+        mantissa *= exact_powers_of_ten[exponent];
+    else
+        mantissa /= exact_powers_of_ten[-exponent];
+    *pvalue = negative ? -mantissa : mantissa;
+    return p;
+}
+
+static const char* skip_line(const char* p, const char* end)
+{
+    const char* newline = NULL;
+
+    newline = (const char*)memchr(p, '\n', (size_t)(end - p));
+    return (newline == NULL) ? end : newline + 1;
+}
+
+static int is_blank_line(const char* p, const char* end)
+{
+    return p == end || *p == '\n' || (*p == '\r' && (p + 1 == end || p[1] == '\n'));
+}
+
+static const char* parse_row(const char* p, const char* end, REAL* row, int d)
+{
+    /* Parses one line of exactly d values into row, returns the start of the next line (NULL on a malformed line) */
+    int j = 0;
+    double value = 0;
+
+    for (j = 0; j < d; j++)
+    {
+        p = parse_double(p, end, &value);
+        row[j] = (REAL)value;
+        if (j < d - 1)
+        {
+            if (p == end || *p != ',')
+                return NULL;
+            p++;
+        }
+    }
+
+    if (p < end && *p == '\r')
+        p++;
+    if (p < end && *p != '\n')
+        return NULL;
+    return (p < end) ? p + 1 : p;
+}
+
+static int parse_chunk(const char* p, const char* end, int d, CSV_ROWS* rows)
+{
+    /* Parses the rows of the chunk into its own buffer, which grows while parsing (the text is read once) */
+    REAL* grown = NULL;
+    size_t capacity = 0;
+
+    while (p != NULL && p < end)
+    {
+        if (is_blank_line(p, end))
+        {
+            p = skip_line(p, end);
+            continue;
+        }
+        if (rows->count == rows->capacity)
+        {
+            capacity = (rows->capacity > CSV_MIN_ROWS / 2) ? 2 * rows->capacity : CSV_MIN_ROWS;
+            grown = (REAL*)realloc(rows->values, capacity * (size_t)d * sizeof(REAL));
+            if (grown == NULL)
+                return 1;
+            rows->values = grown;
+            rows->capacity = capacity;
+        }
+        p = parse_row(p, end, rows->values + rows->count * (size_t)d, d);
+        rows->count++;
+    }
+    return (p == NULL) ? 1 : 0;
+}
+
+int parse_csv_file(char* file_name, PMATRIX* pmatrix)
+{
+    int status = -1;
+    int fd = -1;
+    int c, d = 0;
+    int chunks = 0;
+    int failed = 0;
+    struct stat info;
+    char* text = MAP_FAILED;
+    const char* end = NULL;
+    const char* line = NULL;
+    size_t i = 0;
+    size_t length = 0;
+    size_t line_length = 0;
+    size_t n = 0;
+    size_t* bounds = NULL;
+    size_t* first_rows = NULL;
+    CSV_ROWS* rows = NULL; /* the rows parsed by every chunk */
+    PMATRIX matrix = NULL;
+
+    fd = open(file_name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    length = (size_t)info.st_size;
+
+    text = (char*)mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (text == MAP_FAILED)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    (void)madvise(text, length, MADV_SEQUENTIAL);
+    end = text + length;
+
+    /* d is the number of values on the first line */
+    for (line = text; line < end && is_blank_line(line, end); line = skip_line(line, end))
+        ;
+    if (line == end)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    line_length = (size_t)(skip_line(line, end) - line);
+    for (d = 1; line < end && *line != '\n'; line++)
+        d += (*line == ',');
+
+    /* Cut the file into chunks, every chunk ends at the end of a line */
+    chunks = (int)(length / CSV_CHUNK_BYTES) + 1;
+    bounds = (size_t*)HEAPALLOCZ(bounds, (size_t)chunks + 1);
+    first_rows = (size_t*)HEAPALLOCZ(first_rows, (size_t)chunks + 1);
+    rows = (CSV_ROWS*)HEAPALLOCZ(rows, (size_t)chunks);
+    if (bounds == NULL || first_rows == NULL || rows == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    for (c = 1; c < chunks; c++)
+    {
+        bounds[c] = length / (size_t)chunks * (size_t)c;
+        if (bounds[c] < bounds[c - 1])
+            bounds[c] = bounds[c - 1];
+        else if (bounds[c] > 0 && text[bounds[c] - 1] != '\n')
+            bounds[c] = (size_t)(skip_line(text + bounds[c], end) - text);
+    }
+    bounds[chunks] = length;
+
+    /* One pass over the text: every chunk parses its rows into a buffer sized by the length of the first line,
+    grown when the guess was short. The row counts then place the chunks in the matrix */
+#pragma omp parallel for schedule(dynamic) reduction(|:failed)
+    for (c = 0; c < chunks; c++)
+    {
+        rows[c].capacity = (bounds[c + 1] - bounds[c]) / line_length + 1;
+        rows[c].values = (REAL*)malloc(rows[c].capacity * (size_t)d * sizeof(REAL));
+        failed |= (rows[c].values == NULL) ? 1 : parse_chunk(text + bounds[c], text + bounds[c + 1], d, &rows[c]);
+    }
+    if (failed)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    for (c = 0; c < chunks; c++)
+        first_rows[c + 1] = first_rows[c] + rows[c].count;
+    n = first_rows[chunks];
+    if (n > (size_t)INT_MAX)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    status = create_matrix((int)n, d, &matrix);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+#pragma omp parallel for schedule(dynamic) private(i)
+    for (c = 0; c < chunks; c++)
+        for (i = 0; i < rows[c].count; i++)
+            (void)memcpy(MAT_ROW(matrix, first_rows[c] + i), rows[c].values + i * (size_t)d, (size_t)d * sizeof(REAL));
+
+    /* Transfer ownership */
+    *pmatrix = matrix;
+    matrix = NULL;
+
+    status = 0;
+
+lblCleanup:
+    if (text != MAP_FAILED)
+        (void)munmap(text, length);
+    if (fd >= 0)
+        (void)close(fd);
+    if (rows != NULL)
+        for (c = 0; c < chunks; c++)
+            HEAPFREE(rows[c].values);
+    HEAPFREE(bounds);
+    HEAPFREE(first_rows);
+    HEAPFREE(rows);
+    free_matrix(matrix);
+    return status;
+}
@@ -0,0 +1,575 @@
+/* C Program: the Nystrom (landmark) approximation of W.
+m landmark points are drawn from X, and the similarity matrix is approximated from its nXm block C (every
+point to the landmarks) and its mXm block M (the landmarks among themselves): A ~ C*M^+*C^T = F*F^T. The
+pseudo-inverse comes from a pivoted Cholesky factorization, which keeps the r landmarks J that M has full rank
+on: M_JJ = L*L^T and F = C_J*L^(-T). The diagonal of F*F^T is taken out (A has a zero
+diagonal), the degrees are the row sums of what is left, and W*H = D^(-0.5)*(F*(F^T*D^(-0.5)*H) - diag*D^(-0.5)*H)
+costs O(n*m*k) - neither A nor W is ever formed. */
+#include "symnmf.h"
+
+/* The pseudo-inverse of M drops the landmarks whose similarities the others explain up to NYSTROM_RCOND times
+the largest diagonal of M */
+#define NYSTROM_RCOND (1e-10)
+
+static int compare_indices(const void* a, const void* b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+static int choose_landmarks(int n, int m, unsigned long seed, int* indices)
+{
+    /* m distinct points, uniformly: the first m steps of a Fisher-Yates shuffle, sorted back for locality */
+    int a, b, swap = 0;
+    int* order = NULL;
+    RANDOM_STATE state;
+
+    order = (int*)HEAPALLOCZ(order, (size_t)n);
+    if (order == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+    for (a = 0; a < n; a++)
+        order[a] = a;
+
+    (void)seed_random(&state, seed);
+    for (a = 0; a < m; a++)
+    {
+        b = a + (int)(next_random_double(&state) * (n - a));
+        swap = order[a];
+        order[a] = order[b];
+        order[b] = swap;
+        indices[a] = order[a];
+    }
+    qsort(indices, (size_t)m, sizeof(int), compare_indices);
+
+    HEAPFREE(order);
+    return 0;
+}
+
+static void landmark_similarities(PMATRIX points, PMATRIX landmarks_t, double* landmark_norms, PMATRIX C, SIM_ROW_KERNEL kernel)
+{
+    /* C[i][a] = e^(-||x_i - l_a||^2 / 2), with the same row kernel as the exact similarity matrix */
+    int i, c = 0;
+    double norm_i = 0;
+    REAL* row = NULL;
+
+#pragma omp parallel for schedule(static) private(c, norm_i, row)
+    for (i = 0; i < points->rows; i++)
+    {
+        row = MAT_ROW(points, i);
+        norm_i = 0;
+        for (c = 0; c < points->cols; c++)
+            norm_i += (double)row[c] * row[c];
+        (void)kernel(row, norm_i, landmarks_t, landmark_norms, 0, C->cols, MAT_ROW(C, i));
+    }
+}
+
+static int pivoted_cholesky(double* block, int m, int* pivots, double* lower)
+{
+    /* M ~ G*G^T, one column of G at a time, each time for the landmark whose diagonal is the largest left after
+    the previous columns. It stops once every remaining diagonal is below NYSTROM_RCOND times the largest of M:
+    the landmarks left out are (numerically) combinations of the pivots. lower gets the rXr rows of G of the
+    pivots - the Cholesky factor of M restricted to them. Returns the rank r */
+    int i, j, l = 0;
+    int p = 0;
+    double largest = 0;
+    double pivot = 0;
+    double sum = 0;
+    double* residual = NULL;
+    double* g = NULL;
+
+    residual = (double*)HEAPALLOCZ(residual, (size_t)m);
+    g = (double*)HEAPALLOCZ(g, (size_t)m * (size_t)m);
+    if (residual == NULL || g == NULL)
+    {
+        HEAPFREE(residual);
+        HEAPFREE(g);
+        return -1;
+    }
+
+    for (i = 0; i < m; i++)
+    {
+        residual[i] = block[(size_t)i * m + i];
+        if (residual[i] > largest)
+            largest = residual[i];
+    }
+
+    for (j = 0; j < m; j++)
+    {
+        p = 0;
+        for (i = 1; i < m; i++)
+            if (residual[i] > residual[p])
+                p = i;
+        if (residual[p] <= NYSTROM_RCOND * largest)
+            break;
+        pivots[j] = p;
+        pivot = sqrt(residual[p]);
+
+        /* Column j of G: what the previous columns leave of column p of M */
+#pragma omp parallel for schedule(static) private(l, sum)
+        for (i = 0; i < m; i++)
+        {
+            sum = block[(size_t)i * m + p];
+            for (l = 0; l < j; l++)
+                sum -= g[(size_t)i * m + l] * g[(size_t)p * m + l];
+            g[(size_t)i * m + j] = sum / pivot;
+        }
+        for (i = 0; i < m; i++)
+            residual[i] -= g[(size_t)i * m + j] * g[(size_t)i * m + j];
+        residual[p] = 0; /* exactly, not up to rounding */
+    }
+
+    for (i = 0; i < j; i++)
+        for (l = 0; l < j; l++)
+            lower[(size_t)i * m + l] = (l <= i) ? g[(size_t)pivots[i] * m + l] : 0;
+
+    HEAPFREE(residual);
+    HEAPFREE(g);
+    return j;
+}
+
+static void invert_lower(double* lower, int r, int stride, double* inverse)
+{
+    /* inverse = lower^(-1) by forward substitution, column by column (both lower triangular) */
+    int i, j, l = 0;
+    double sum = 0;
+
+#pragma omp parallel for schedule(dynamic) private(i, l, sum)
+    for (j = 0; j < r; j++)
+    {
+        for (i = 0; i < j; i++)
+            inverse[(size_t)i * stride + j] = 0;
+        inverse[(size_t)j * stride + j] = 1 / lower[(size_t)j * stride + j];
+        for (i = j + 1; i < r; i++)
+        {
+            sum = 0;
+            for (l = j; l < i; l++)
+                sum += lower[(size_t)i * stride + l] * inverse[(size_t)l * stride + j];
+            inverse[(size_t)i * stride + j] = -sum / lower[(size_t)i * stride + i];
+        }
+    }
+}
+
+static int normalize_factor(PW_NYSTROM nystrom)
+{
+    /* The degrees of F*F^T without its diagonal: d_i = f_i . (sum of the rows of F) - ||f_i||^2.
+    A row the approximation leaves without a positive degree gets no weight at all */
+    int i, c = 0;
+    int n, r = 0;
+    double degree = 0;
+    double* sums = NULL;
+    REAL* row = NULL;
+
+    n = nystrom->factor->rows;
+    r = nystrom->factor->cols;
+
+    sums = (double*)HEAPALLOCZ(sums, (size_t)r + 1);
+    if (sums == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+
+#pragma omp parallel for schedule(static) private(c, row) reduction(+:sums[:r])
+    for (i = 0; i < n; i++)
+    {
+        row = MAT_ROW(nystrom->factor, i);
+        for (c = 0; c < r; c++)
+            sums[c] += row[c];
+    }
+
+#pragma omp parallel for schedule(static) private(c, row, degree)
+    for (i = 0; i < n; i++)
+    {
+        row = MAT_ROW(nystrom->factor, i);
+        nystrom->diagonal[i] = 0;
+        degree = 0;
+        for (c = 0; c < r; c++)
+        {
+            nystrom->diagonal[i] += (double)row[c] * row[c];
+            degree += row[c] * sums[c];
+        }
+        degree -= nystrom->diagonal[i];
+        nystrom->scale[i] = (degree > 0) ? pow(degree, -0.5) : 0;
+    }
+
+    HEAPFREE(sums);
+    return 0;
+}
+
+int sym_nystrom(PMATRIX initial, int m, unsigned long seed, PW_NYSTROM* pnystrom)
+{
+    int status = -1;
+    int a, b = 0;
+    int n, r = 0;
+    int* indices = NULL;
+    int* pivots = NULL;
+    double* block = NULL;
+    double* lower = NULL;
+    double* landmark_norms = NULL;
+    PMATRIX landmarks = NULL;
+    PMATRIX landmarks_t = NULL;
+    PMATRIX similarities = NULL;
+    PMATRIX transform = NULL;
+    PW_NYSTROM nystrom = NULL;
+
+    n = initial->rows;
+    if (m > n)
+        m = n;
+    if (m < 1)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    nystrom = (PW_NYSTROM)HEAPALLOCZ(nystrom, 1);
+    indices = (int*)HEAPALLOCZ(indices, (size_t)m);
+    pivots = (int*)HEAPALLOCZ(pivots, (size_t)m);
+    block = (double*)HEAPALLOCZ(block, (size_t)m * (size_t)m);
+    lower = (double*)HEAPALLOCZ(lower, (size_t)m * (size_t)m);
+    if (nystrom == NULL || indices == NULL || pivots == NULL || block == NULL || lower == NULL ||
+        create_matrix(m, initial->cols, &landmarks) != 0 ||
+        create_matrix(n, m, &similarities) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    nystrom->diagonal = (double*)HEAPALLOCZ(nystrom->diagonal, (size_t)n + 1);
+    nystrom->scale = (double*)HEAPALLOCZ(nystrom->scale, (size_t)n + 1);
+    if (nystrom->diagonal == NULL || nystrom->scale == NULL ||
+        choose_landmarks(n, m, seed, indices) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* C: every point to the landmarks */
+    for (a = 0; a < m; a++)
+        (void)memcpy(MAT_ROW(landmarks, a), MAT_ROW(initial, indices[a]), (size_t)initial->cols * sizeof(REAL));
+    status = prepare_points(landmarks, &landmarks_t, &landmark_norms);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    (void)landmark_similarities(initial, landmarks_t, landmark_norms, similarities, get_sim_kernel());
+
+    /* M: the rows of C of the landmarks themselves (with their unit diagonal), symmetrized against rounding */
+    for (a = 0; a < m; a++)
+        for (b = 0; b < m; b++)
+            block[(size_t)a * m + b] = 0.5 * ((double)MAT_AT(similarities, indices[a], b) + MAT_AT(similarities, indices[b], a));
+
+    /* The landmarks the pseudo-inverse keeps, and the inverse of the Cholesky factor of M restricted to them */
+    r = pivoted_cholesky(block, m, pivots, lower);
+    if (r < 1)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    (void)invert_lower(lower, r, m, block); /* M itself is done with */
+
+    /* T: mXr, row pivots[j] of T is column j of L^(-1), so C*T = C_J*L^(-T) */
+    status = create_matrix(m, r, &transform);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    for (a = 0; a < r; a++)
+        for (b = 0; b < r; b++)
+            MAT_AT(transform, pivots[a], b) = (REAL)block[(size_t)b * m + a];
+
+    /* F = C*T, C isn't needed past this point */
+    status = create_matrix(n, r, &nystrom->factor);
+    if (status != 0 || gemm(similarities, transform, nystrom->factor, NULL) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    free_matrix(similarities);
+    similarities = NULL;
+
+    status = normalize_factor(nystrom);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* Transfer ownership */
+    *pnystrom = nystrom;
+    nystrom = NULL;
+
+    status = 0;
+
+lblCleanup:
+    free_nystrom(nystrom);
+    free_matrix(landmarks);
+    free_matrix(landmarks_t);
+    free_matrix(similarities);
+    free_matrix(transform);
+    HEAPFREE(landmark_norms);
+    HEAPFREE(indices);
+    HEAPFREE(pivots);
+    HEAPFREE(block);
+    HEAPFREE(lower);
+    return status;
+}
+
+void free_nystrom(PW_NYSTROM nystrom)
+{
+    if (nystrom != NULL)
+    {
+        free_matrix(nystrom->factor);
+        free_matrix(nystrom->scaled_h);
+        free_matrix(nystrom->projected);
+        HEAPFREE(nystrom->diagonal);
+        HEAPFREE(nystrom->scale);
+        HEAPFREE(nystrom);
+    }
+}
+
+static int project(PMATRIX F, PMATRIX X, PMATRIX P)
+{
+    /* P = F^T * X over the rows of both, like gram: each thread sums the rank-1 updates f_i^T * x_i in double */
+    int i, c, j = 0;
+    int r, k = 0;
+    double f_c = 0;
+    double* p = NULL;
+    double* p_row = NULL;
+    REAL* f_row = NULL;
+    REAL* x_row = NULL;
+
+    r = F->cols;
+    k = X->cols;
+
+    p = (double*)HEAPALLOCZ(p, (size_t)r * (size_t)k + 1);
+    if (p == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+
+#pragma omp parallel for schedule(static) private(c, j, f_c, p_row, f_row, x_row) reduction(+:p[:r * k])
+    for (i = 0; i < F->rows; i++)
+    {
+        f_row = MAT_ROW(F, i);
+        x_row = MAT_ROW(X, i);
+        for (c = 0; c < r; c++)
+        {
+            f_c = f_row[c];
+            p_row = p + (size_t)c * k;
+            for (j = 0; j < k; j++)
+                p_row[j] += f_c * x_row[j];
+        }
+    }
+
+    for (c = 0; c < r; c++)
+        for (j = 0; j < k; j++)
+            MAT_AT(P, c, j) = (REAL)p[(size_t)c * k + j];
+
+    HEAPFREE(p);
+    return 0;
+}
+
+static int nystrom_product(void* w, PMATRIX H, PMATRIX WH, PGEMM_WORKSPACE workspace)
+{
+    int i, j = 0;
+    int n, r = 0;
+    double value = 0;
+    REAL* wh_row = NULL;
+    REAL* h_row = NULL;
+    PW_NYSTROM nystrom = (PW_NYSTROM)w;
+
+    (void)workspace; /* the products are all tall-skinny */
+    n = nystrom->factor->rows;
+    r = nystrom->factor->cols;
+
+    /* The scratch follows the width of H */
+    if (nystrom->scaled_h != NULL && nystrom->scaled_h->cols != H->cols)
+    {
+        free_matrix(nystrom->scaled_h);
+        free_matrix(nystrom->projected);
+        nystrom->scaled_h = NULL;
+        nystrom->projected = NULL;
+    }
+    if (nystrom->scaled_h == NULL &&
+        (create_matrix(n, H->cols, &nystrom->scaled_h) != 0 || create_matrix(r, H->cols, &nystrom->projected) != 0))
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+
+    /* F * (F^T * D^(-0.5)*H) */
+    (void)scale_rows(H, nystrom->scale, nystrom->scaled_h);
+    if (project(nystrom->factor, nystrom->scaled_h, nystrom->projected) != 0)
+        return 1;
+    (void)mult_small(nystrom->factor, nystrom->projected, WH);
+
+    /* Without the diagonal, and scaled back. The approximation may dip below 0 where A is about 0,
+    which the multiplicative update can't take (H must stay non-negative). The clamp makes this product differ
+    from the W of nystrom_squared_norm, see there */
+#pragma omp parallel for schedule(static) private(j, value, wh_row, h_row)
+    for (i = 0; i < n; i++)
+    {
+        wh_row = MAT_ROW(WH, i);
+        h_row = MAT_ROW(nystrom->scaled_h, i);
+        for (j = 0; j < H->cols; j++)
+        {
+            value = nystrom->scale[i] * (wh_row[j] - nystrom->diagonal[i] * h_row[j]);
+            wh_row[j] = (REAL)((value > 0) ? value : 0);
+        }
+    }
+
+    return 0;
+}
+
+static int nystrom_squared_norm(void* w, double* pnorm)
+{
+    /* ||S*F*F^T*S||^2 = ||F^T*S^2*F||^2 for S = D^(-0.5), an rXr matrix, less the diagonal s_i^2 * ||f_i||^2.
+    This is the norm of the unclamped approximation, while tr(H^T*W*H) comes from the clamped product. A clamped
+    product isn't linear, no W has it, so the residual of the solvers is only approximate here: H >= 0 and the clamp
+    only raises entries, so the trace is too large and the residual underestimates ||W - H*H^T||_F^2 of the
+    unclamped W, by twice the H-weighted sum of the clamped entries. A target_residual or the 'objective'
+    criterion may then stop early */
+    int i, a, b = 0;
+    int r = 0;
+    double f_a = 0;
+    double total = 0;
+    double* g = NULL;
+    REAL* row = NULL;
+    PW_NYSTROM nystrom = (PW_NYSTROM)w;
+
+    r = nystrom->factor->cols;
+
+    g = (double*)HEAPALLOCZ(g, (size_t)r * (size_t)r + 1);
+    if (g == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+
+#pragma omp parallel for schedule(static) private(a, b, f_a, row) reduction(+:g[:r * r])
+    for (i = 0; i < nystrom->factor->rows; i++)
+    {
+        row = MAT_ROW(nystrom->factor, i);
+        for (a = 0; a < r; a++)
+        {
+            f_a = row[a] * nystrom->scale[i] * nystrom->scale[i];
+            for (b = 0; b < r; b++)
+                g[(size_t)a * r + b] += f_a * row[b];
+        }
+    }
+
+    for (a = 0; a < r * r; a++)
+        total += g[a] * g[a];
+    for (i = 0; i < nystrom->factor->rows; i++)
+        total -= pow(nystrom->scale[i] * nystrom->scale[i] * nystrom->diagonal[i], 2);
+
+    HEAPFREE(g);
+    *pnorm = total;
+    return 0;
+}
+
+void nystrom_operator(PW_NYSTROM nystrom, PW_OPERATOR op)
+{
+    op->w = nystrom;
+    op->product = nystrom_product;
+    op->squared_norm = nystrom_squared_norm;
+}
+
+int nystrom_error(PMATRIX initial, int m, unsigned long seed, double* perror)
+{
+    /* The accuracy report: the exact W is formed (so only for small n) and compared entry by entry */
+    int status = -1;
+    int i, j, c = 0;
+    int n, r = 0;
+    double dot = 0;
+    double diff = 0;
+    double error = 0;
+    double total = 0;
+    double* degrees = NULL;
+    REAL* row = NULL;
+    REAL* f_i = NULL;
+    REAL* f_j = NULL;
+    PMATRIX sim = NULL;
+    PW_NYSTROM nystrom = NULL;
+
+    n = initial->rows;
+
+    status = sym_ddg(initial, &sim, &degrees);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+    (void)norm_in_place(sim, degrees);
+
+    status = sym_nystrom(initial, m, seed, &nystrom);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+    r = nystrom->factor->cols;
+
+#pragma omp parallel for schedule(static) private(j, c, dot, diff, row, f_i, f_j) reduction(+:error, total)
+    for (i = 0; i < n; i++)
+    {
+        row = MAT_ROW(sim, i);
+        f_i = MAT_ROW(nystrom->factor, i);
+        for (j = 0; j < n; j++)
+        {
+            dot = 0;
+            if (j != i)
+            {
+                f_j = MAT_ROW(nystrom->factor, j);
+                for (c = 0; c < r; c++)
+                    dot += (double)f_i[c] * f_j[c];
+            }
+            diff = nystrom->scale[i] * dot * nystrom->scale[j] - row[j];
+            error += diff * diff;
+            total += (double)row[j] * row[j];
+        }
+    }
+
+    *perror = (total > 0) ? sqrt(error / total) : 0;
+
+    status = 0;
+
+lblCleanup:
+    free_nystrom(nystrom);
+    free_matrix(sim);
+    HEAPFREE(degrees);
+    return status;
+}
+
+int symnmf_fit_nystrom(PMATRIX initial, int k, int m, unsigned long seed, PMATRIX* ph)
+{
+    /* symnmf_fit with the low-rank W, the landmarks are drawn with the seed of H_0 */
+    int status = -1;
+    PW_NYSTROM nystrom = NULL;
+    W_OPERATOR op;
+
+    status = sym_nystrom(initial, m, seed, &nystrom);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+    (void)nystrom_operator(nystrom, &op);
+
+    status = symnmf_fit_operator(&op, initial->rows, k, seed, ph);
+
+lblCleanup:
+    free_nystrom(nystrom);
+    return status;
+}
@@ -0,0 +1,334 @@
+/* C Program: the out-of-core mode of symnmf.
+For large n the dense nXn W doesn't fit in memory, while the iterations only ever need W*H.
+A is written once, in row tiles, to a memory-mapped scratch file, and W*H = D^(-0.5)*A*(D^(-0.5)*H) is
+computed by streaming A back tile by tile: the next tile is read ahead while the current one is multiplied,
+and the pages of a finished tile are dropped, so only about two tiles of A are resident at any time. */
+#include "symnmf.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Rows of a tile that share the columns of the transposed points while they are in L1 */
+#define TILE_BLOCK_ROWS (16)
+/* Name of the scratch file under the scratch directory (mkstemp fills the X's), unlinked as soon as it is mapped */
+#define SCRATCH_FILE_TEMPLATE "/symnmf-XXXXXX"
+
+static void advise_rows(PMATRIX sim, int r0, int r1, int advice)
+{
+    /* madvise works on whole pages, the rows of a tile start anywhere in a page */
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char* base = (char*)sim->mapping;
+    char* start = (char*)MAT_ROW(sim, r0);
+    char* end = (char*)MAT_ROW(sim, r1);
+
+    start = base + ((size_t)(start - base) / page) * page;
+    if (end > start)
+        (void)madvise(start, (size_t)(end - start), advice);
+}
+
+static int create_scratch_matrix(char* scratch_dir, int rows, int cols, PMATRIX* pmatrix)
+{
+    /* Like create_matrix, but the rows live in a shared mapping of a file instead of the heap, so the kernel
+    pages them out to the file rather than to swap. The file is unlinked right away: it goes away with the mapping */
+    int status = -1;
+    int fd = -1;
+    int stride = 0;
+    size_t length = 0;
+    void* mapping = MAP_FAILED;
+    char* path = NULL;
+    PMATRIX matrix = NULL;
+
+    stride = MATRIX_STRIDE(cols);
+    length = (size_t)rows * (size_t)stride * sizeof(REAL);
+    if (length == 0)
+        length = MATRIX_ALIGNMENT;
+
+    path = (char*)HEAPALLOCZ(path, strlen(scratch_dir) + sizeof(SCRATCH_FILE_TEMPLATE));
+    matrix = (PMATRIX)HEAPALLOCZ(matrix, 1);
+    if (path == NULL || matrix == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    (void)strcpy(path, scratch_dir);
+    (void)strcat(path, SCRATCH_FILE_TEMPLATE);
+
+    fd = mkstemp(path);
+    if (fd < 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    (void)unlink(path);
+
+    /* The file is sparse until the tiles are written */
+    if (ftruncate(fd, (off_t)length) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* free_matrix unmaps it */
+    matrix->data = (REAL*)mapping;
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->stride = stride;
+    matrix->mapping = mapping;
+    matrix->mapping_length = length;
+
+    /* Transfer ownership */
+    *pmatrix = matrix;
+    matrix = NULL;
+
+    status = 0;
+
+lblCleanup:
+    if (fd >= 0)
+        (void)close(fd);
+    HEAPFREE(path);
+    HEAPFREE(matrix);
+    return status;
+}
+
+static void sim_tile(PMATRIX points, PMATRIX points_t, double* norms, PMATRIX sim, double* degrees,
+    int r0, int r1, int columns, SIM_ROW_KERNEL kernel)
+{
+    /* Rows r0..r1-1 of A, whole: the mirrored half of pairwise_exp would write into tiles that are already
+    on disk, so every entry is evaluated from its own row (twice the exponents, but each tile is written once) */
+    int i, i0, i1, j, j0, j1 = 0;
+    int n = points->rows;
+    double row_sum = 0;
+    REAL* row = NULL;
+
+#pragma omp parallel for schedule(dynamic) private(i, i1, j, j0, j1, row, row_sum)
+    for (i0 = r0; i0 < r1; i0 += TILE_BLOCK_ROWS)
+    {
+        i1 = (r1 - i0 < TILE_BLOCK_ROWS) ? r1 : i0 + TILE_BLOCK_ROWS;
+        for (j0 = 0; j0 < n; j0 += columns)
+        {
+            j1 = (n - j0 < columns) ? n : j0 + columns;
+            for (i = i0; i < i1; i++)
+                (void)kernel(MAT_ROW(points, i), norms[i], points_t, norms, j0, j1, MAT_ROW(sim, i));
+        }
+
+        /* The diagonal is defined as 0 */
+        for (i = i0; i < i1; i++)
+        {
+            row = MAT_ROW(sim, i);
+            row[i] = 0;
+            row_sum = 0;
+            for (j = 0; j < n; j++)
+                row_sum += row[j];
+            degrees[i] = row_sum;
+        }
+    }
+}
+
+int sym_tiles(PMATRIX initial, char* scratch_dir, PW_TILES* ptiles)
+{
+    int status = -1;
+    int i, r0, r1 = 0;
+    int n = 0;
+    int columns = 0;
+    size_t row_bytes = 0;
+    double* norms = NULL;
+    PMATRIX points_t = NULL;
+    PW_TILES tiles = NULL;
+    SIM_ROW_KERNEL kernel = get_sim_kernel();
+
+    n = initial->rows;
+
+    tiles = (PW_TILES)HEAPALLOCZ(tiles, 1);
+    if (tiles == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    tiles->scale = (double*)HEAPALLOCZ(tiles->scale, (size_t)n + 1);
+    if (tiles->scale == NULL ||
+        create_scratch_matrix(scratch_dir, n, n, &tiles->sim) != 0 ||
+        prepare_points(initial, &points_t, &norms) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* A tile of about W_TILE_BYTES, but at least a GEMM_MC block of rows for every thread of the products */
+    row_bytes = (size_t)tiles->sim->stride * sizeof(REAL);
+    tiles->tile_rows = (int)(W_TILE_BYTES / row_bytes);
+    if (tiles->tile_rows < GEMM_MC * get_thread_count())
+        tiles->tile_rows = GEMM_MC * get_thread_count();
+    tiles->tile_rows = ((tiles->tile_rows + GEMM_MC - 1) / GEMM_MC) * GEMM_MC;
+
+    /* Written tile by tile, each one dropped from memory once done (the page cache writes it back) */
+    columns = sim_tile_columns(initial->cols);
+    for (r0 = 0; r0 < n; r0 += tiles->tile_rows)
+    {
+        r1 = (n - r0 < tiles->tile_rows) ? n : r0 + tiles->tile_rows;
+        (void)sim_tile(initial, points_t, norms, tiles->sim, tiles->scale, r0, r1, columns, kernel);
+        (void)advise_rows(tiles->sim, r0, r1, MADV_DONTNEED);
+    }
+
+    /* Turn the degrees into the diagonal of D^(-0.5), A itself is never normalized */
+    for (i = 0; i < n; i++)
+        tiles->scale[i] = pow(tiles->scale[i], -0.5);
+
+    /* Transfer ownership */
+    *ptiles = tiles;
+    tiles = NULL;
+
+    status = 0;
+
+lblCleanup:
+    free_tiles(tiles);
+    free_matrix(points_t);
+    HEAPFREE(norms);
+    return status;
+}
+
+void free_tiles(PW_TILES tiles)
+{
+    if (tiles != NULL)
+    {
+        free_matrix(tiles->sim);
+        free_matrix(tiles->scaled_h);
+        HEAPFREE(tiles->scale);
+        HEAPFREE(tiles);
+    }
+}
+
+static int tiled_product(void* w, PMATRIX H, PMATRIX WH, PGEMM_WORKSPACE workspace)
+{
+    int r0, r1 = 0;
+    int n = 0;
+    MATRIX tile;
+    MATRIX tile_wh;
+    PW_TILES tiles = (PW_TILES)w;
+
+    n = tiles->sim->rows;
+
+    /* The scratch follows the width of H */
+    if (tiles->scaled_h != NULL && tiles->scaled_h->cols != H->cols)
+    {
+        free_matrix(tiles->scaled_h);
+        tiles->scaled_h = NULL;
+    }
+    if (tiles->scaled_h == NULL && create_matrix(n, H->cols, &tiles->scaled_h) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+    (void)scale_rows(H, tiles->scale, tiles->scaled_h);
+
+    /* Row views of A and WH, owned by the matrices they look into */
+    tile = *tiles->sim;
+    tile.mapping = NULL;
+    tile.borrowed = 1;
+    tile_wh = *WH;
+    tile_wh.mapping = NULL;
+    tile_wh.borrowed = 1;
+
+    (void)advise_rows(tiles->sim, 0, (n < tiles->tile_rows) ? n : tiles->tile_rows, MADV_WILLNEED);
+    for (r0 = 0; r0 < n; r0 += tiles->tile_rows)
+    {
+        r1 = (n - r0 < tiles->tile_rows) ? n : r0 + tiles->tile_rows;
+
+        /* The kernel reads the next tile while this one is multiplied */
+        if (r1 < n)
+            (void)advise_rows(tiles->sim, r1, (n - r1 < tiles->tile_rows) ? n : r1 + tiles->tile_rows, MADV_WILLNEED);
+
+        tile.data = MAT_ROW(tiles->sim, r0);
+        tile.rows = r1 - r0;
+        tile_wh.data = MAT_ROW(WH, r0);
+        tile_wh.rows = r1 - r0;
+        if (gemm(&tile, tiles->scaled_h, &tile_wh, workspace) != 0)
+        {
+            printf("An Error Has Occurred\n");
+            return 1;
+        }
+
+        (void)advise_rows(tiles->sim, r0, r1, MADV_DONTNEED);
+    }
+
+    (void)scale_rows(WH, tiles->scale, WH);
+    return 0;
+}
+
+static int tiled_squared_norm(void* w, double* pnorm)
+{
+    /* One more pass over A, streamed like the products: the sum of (a_ij * s_i * s_j)^2 */
+    int i, j, r0, r1 = 0;
+    int n = 0;
+    double row_sum = 0;
+    double total = 0;
+    REAL* row = NULL;
+    PW_TILES tiles = (PW_TILES)w;
+
+    n = tiles->sim->rows;
+
+    (void)advise_rows(tiles->sim, 0, (n < tiles->tile_rows) ? n : tiles->tile_rows, MADV_WILLNEED);
+    for (r0 = 0; r0 < n; r0 += tiles->tile_rows)
+    {
+        r1 = (n - r0 < tiles->tile_rows) ? n : r0 + tiles->tile_rows;
+        if (r1 < n)
+            (void)advise_rows(tiles->sim, r1, (n - r1 < tiles->tile_rows) ? n : r1 + tiles->tile_rows, MADV_WILLNEED);
+
+#pragma omp parallel for schedule(static) private(j, row, row_sum) reduction(+:total)
+        for (i = r0; i < r1; i++)
+        {
+            row = MAT_ROW(tiles->sim, i);
+            row_sum = 0;
+            for (j = 0; j < n; j++)
+                row_sum += (row[j] * tiles->scale[j]) * (row[j] * tiles->scale[j]);
+            total += row_sum * tiles->scale[i] * tiles->scale[i];
+        }
+
+        (void)advise_rows(tiles->sim, r0, r1, MADV_DONTNEED);
+    }
+
+    *pnorm = total;
+    return 0;
+}
+
+void tiled_operator(PW_TILES tiles, PW_OPERATOR op)
+{
+    op->w = tiles;
+    op->product = tiled_product;
+    op->squared_norm = tiled_squared_norm;
+}
+
+int symnmf_fit_out_of_core(PMATRIX initial, int k, unsigned long seed, char* scratch_dir, PMATRIX* ph)
+{
+    /* symnmf_fit, except that W is only ever seen through its products */
+    int status = -1;
+    PW_TILES tiles = NULL;
+    W_OPERATOR op;
+
+    status = sym_tiles(initial, scratch_dir, &tiles);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+    (void)tiled_operator(tiles, &op);
+
+    status = symnmf_fit_operator(&op, initial->rows, k, seed, ph);
+
+lblCleanup:
+    free_tiles(tiles);
+    return status;
+}
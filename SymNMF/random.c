@@ -0,0 +1,66 @@
+/* C Program: the random initialization of H, done on the C side.
+The generator is MT19937 seeded like numpy's legacy np.random.seed(seed), and the doubles are drawn like
+np.random.uniform, so the H of symnmf_fit is the one symnmf.py used to build with numpy for the same seed. */
+#include "symnmf.h"
+
+#define MT_M (397)
+#define MT_MATRIX_A (0x9908b0dfUL)
+#define MT_UPPER_MASK (0x80000000UL)
+#define MT_LOWER_MASK (0x7fffffffUL)
+#define MT_WORD_MASK (0xffffffffUL)
+
+void seed_random(PRANDOM_STATE state, unsigned long seed)
+{
+    /* init_genrand of the reference implementation */
+    int i = 0;
+
+    state->mt[0] = seed & MT_WORD_MASK;
+    for (i = 1; i < MT_N; i++)
+        state->mt[i] = (1812433253UL * (state->mt[i - 1] ^ (state->mt[i - 1] >> 30)) + (unsigned long)i) & MT_WORD_MASK;
+    state->index = MT_N;
+}
+
+static unsigned long next_random_word(PRANDOM_STATE state)
+{
+    /* genrand_int32: regenerates the whole state every MT_N words */
+    int i = 0;
+    unsigned long y = 0;
+
+    if (state->index >= MT_N)
+    {
+        for (i = 0; i < MT_N; i++)
+        {
+            y = (state->mt[i] & MT_UPPER_MASK) | (state->mt[(i + 1) % MT_N] & MT_LOWER_MASK);
+            state->mt[i] = state->mt[(i + MT_M) % MT_N] ^ (y >> 1) ^ ((y & 1UL) ? MT_MATRIX_A : 0UL);
+        }
+        state->index = 0;
+    }
+
+    y = state->mt[state->index++];
+    y ^= (y >> 11);
+    y ^= (y << 7) & 0x9d2c5680UL;
+    y ^= (y << 15) & 0xefc60000UL;
+    y ^= (y >> 18);
+    return y & MT_WORD_MASK;
+}
+
+double next_random_double(PRANDOM_STATE state)
+{
+    /* A uniform double in [0, 1) with 53 random bits, from two words (genrand_res53) */
+    unsigned long a = next_random_word(state) >> 5;
+    unsigned long b = next_random_word(state) >> 6;
+
+    return ((double)a * 67108864.0 + (double)b) / 9007199254740992.0;
+}
+
+void fill_uniform(PMATRIX matrix, double high, unsigned long seed)
+{
+    /* matrix[i][j] ~ U[0, high), drawn row by row like np.random.uniform(0, high, (rows, cols)) */
+    int i, j = 0;
+    RANDOM_STATE state;
+
+    (void)seed_random(&state, seed);
+    for (i = 0; i < matrix->rows; i++)
+        for (j = 0; j < matrix->cols; j++)
+            MAT_AT(matrix, i, j) = (REAL)(high * next_random_double(&state));
+}
@@ -1,9 +1,16 @@
 """ This is the build used to create the *.so file 
 that will allow symnmf.py to import symnmfmodule.c """
 
+import os
 from setuptools import Extension, setup
 
-module = Extension("symnmf_capi", sources=['symnmf.c', 'symnmfmodule.c'])
+module = Extension("symnmf_capi",
+                   sources=['symnmf.c', 'gemm.c', 'simd.c', 'sparse.c', 'matio.c', 'random.c', 'outofcore.c', 'nystrom.c', 'solvers.c', 'stream.c', 'sweep.c', 'silhouette.c', 'kmeans.c', 'bench.c', 'symnmfmodule.c'],
+                   # PRECISION=-DSYMNMF_FLOAT32 builds the single precision extension (see the Makefile)
+                   extra_compile_args=['-fopenmp'] + os.environ.get('PRECISION', '').split(),
+                   extra_link_args=['-fopenmp'],
+                   # build.flags (written by the Makefile) changes with the flags, so a build with another PRECISION rebuilds
+                   depends=[name for name in ['symnmf.h', 'build.flags'] if os.path.exists(name)])
 setup(name='symnmf_capi',
      version='1.0',
      description='Python wrapper for our symnmf C extension',
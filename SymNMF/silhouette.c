@@ -0,0 +1,154 @@
+/* C Program: evaluating a clustering without the nXn distance matrix.
+The silhouette of point i in cluster c is s = (b - a) / max(a, b), for a = the mean distance from i to the rest of c
+and b = the smallest mean distance from i to another cluster (0 for a point alone in its cluster), as in sklearn.
+Only the k sums of distances of a point to every cluster are needed: they are accumulated over blocks of rows
+against tiles of the transposed points (like the tiles of sym), so the memory is O(k + tile) per thread. */
+#include "symnmf.h"
+
+/* Rows that share a tile of the transposed points while it is in L1 */
+#define SILHOUETTE_BLOCK_ROWS (16)
+
+void assign_clusters(PMATRIX H, int* labels)
+{
+    /* labels[i] = the argmax of row i, the first one on ties (like np.argmax) */
+    int i, j = 0;
+    int label = 0;
+    REAL* row = NULL;
+
+#pragma omp parallel for schedule(static) private(j, label, row)
+    for (i = 0; i < H->rows; i++)
+    {
+        row = MAT_ROW(H, i);
+        label = 0;
+        for (j = 1; j < H->cols; j++)
+            if (row[j] > row[label])
+                label = j;
+        labels[i] = label;
+    }
+}
+
+static double point_silhouette(const double* sums, const int* sizes, int k, int label)
+{
+    /* s of a point from its sums of distances to every cluster */
+    int j = 0;
+    double a = 0;
+    double b = HUGE_VAL;
+
+    if (sizes[label] < 2)
+        return 0;
+
+    a = sums[label] / (sizes[label] - 1);
+    for (j = 0; j < k; j++)
+        if (j != label && sizes[j] > 0 && sums[j] / sizes[j] < b)
+            b = sums[j] / sizes[j];
+
+    return (a > 0 || b > 0) ? (b - a) / ((a > b) ? a : b) : 0;
+}
+
+int silhouette(PMATRIX points, int* labels, int k, double* pscore)
+{
+    /* The mean silhouette of the points, labels in 0..k-1 with 2..n-1 distinct ones (as sklearn requires) */
+    int status = -1;
+    int i, i0, i1, j, j0, j1, c, t = 0;
+    int n = points->rows;
+    int d = points->cols;
+    int columns = 0;
+    int clusters = 0;
+    int threads = get_thread_count();
+    int* sizes = NULL;
+    double total = 0;
+    double diff = 0;
+    double* norms = NULL;
+    double* distances = NULL; /* per thread: the squared distances of a row to a tile */
+    double* sums = NULL; /* per thread: the sums of distances of a block of rows to every cluster */
+    double* row_distances = NULL;
+    double* row_sums = NULL;
+    REAL* xi = NULL;
+    REAL* coords = NULL;
+    PMATRIX points_t = NULL;
+
+    sizes = (int*)HEAPALLOCZ(sizes, (size_t)k + 1);
+    if (sizes == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (labels[i] < 0 || labels[i] >= k)
+        {
+            printf("An Error Has Occurred\n");
+            status = 1;
+            goto lblCleanup;
+        }
+        if (sizes[labels[i]]++ == 0)
+            clusters++;
+    }
+    if (clusters < 2 || clusters > n - 1)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    columns = sim_tile_columns(d);
+    distances = (double*)heap_alloc_aligned((size_t)threads * (size_t)columns * sizeof(double));
+    sums = (double*)HEAPALLOCZ(sums, (size_t)threads * SILHOUETTE_BLOCK_ROWS * (size_t)k);
+    if (distances == NULL || sums == NULL ||
+        prepare_points(points, &points_t, &norms) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+#pragma omp parallel for schedule(dynamic) num_threads(threads) private(i, i1, j, j0, j1, c, t, diff, xi, coords, row_distances, row_sums) reduction(+:total)
+    for (i0 = 0; i0 < n; i0 += SILHOUETTE_BLOCK_ROWS)
+    {
+        t = get_thread_index();
+        i1 = (n - i0 < SILHOUETTE_BLOCK_ROWS) ? n : i0 + SILHOUETTE_BLOCK_ROWS;
+        row_distances = distances + (size_t)t * (size_t)columns;
+        (void)memset(sums + (size_t)t * SILHOUETTE_BLOCK_ROWS * (size_t)k, 0, SILHOUETTE_BLOCK_ROWS * (size_t)k * sizeof(double));
+
+        for (j0 = 0; j0 < n; j0 += columns)
+        {
+            j1 = (n - j0 < columns) ? n : j0 + columns;
+            for (i = i0; i < i1; i++)
+            {
+                /* The coords go one after the other over the whole tile, which keeps the inner loop vectorizable */
+                xi = MAT_ROW(points, i);
+                for (j = 0; j < j1 - j0; j++)
+                    row_distances[j] = 0;
+                for (c = 0; c < d; c++)
+                {
+                    coords = MAT_ROW(points_t, c) + j0;
+                    for (j = 0; j < j1 - j0; j++)
+                    {
+                        diff = (double)xi[c] - coords[j];
+                        row_distances[j] += diff * diff;
+                    }
+                }
+
+                row_sums = sums + ((size_t)t * SILHOUETTE_BLOCK_ROWS + (size_t)(i - i0)) * (size_t)k;
+                for (j = j0; j < j1; j++)
+                    row_sums[labels[j]] += sqrt(row_distances[j - j0]);
+            }
+        }
+
+        for (i = i0; i < i1; i++)
+            total += point_silhouette(sums + ((size_t)t * SILHOUETTE_BLOCK_ROWS + (size_t)(i - i0)) * (size_t)k,
+                sizes, k, labels[i]);
+    }
+
+    *pscore = total / n;
+    status = 0;
+
+lblCleanup:
+    HEAPFREE(sizes);
+    HEAPFREE(distances);
+    HEAPFREE(sums);
+    HEAPFREE(norms);
+    free_matrix(points_t);
+    return status;
+}
@@ -0,0 +1,375 @@
+/* C Program: the vectorized pairwise similarity engine used by sym().
+Every entry is e^(-0.5 * ||x_i - x_j||^2), computed as ||x_i||^2 + ||x_j||^2 - 2 * x_i.x_j so the inner
+loop is a fused multiply-add over a transposed copy of the points (one SIMD lane per column j),
+followed by a vectorized exp over the whole row tile.
+The kernel is chosen once at runtime according to the CPU, with a scalar fallback.
+With single precision matrices the kernels still compute in double (the coords are widened on load),
+and every entry is rounded to float once, when it is stored. */
+#include "symnmf.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(SYMNMF_NO_SIMD)
+#define SYMNMF_X86_SIMD
+#include <immintrin.h>
+
+/* Loads/stores of 4 (AVX2) or 8 (AVX-512) elements of a matrix, as doubles */
+#ifdef SYMNMF_FLOAT32
+#define LOAD4_PD(p) _mm256_cvtps_pd(_mm_loadu_ps(p))
+#define STORE4_PD(p, v) _mm_storeu_ps((p), _mm256_cvtpd_ps(v))
+#define LOAD8_PD(p) _mm512_cvtps_pd(_mm256_loadu_ps(p))
+#define STORE8_PD(p, v) _mm256_storeu_ps((p), _mm512_cvtpd_ps(v))
+#else
+#define LOAD4_PD(p) _mm256_loadu_pd(p)
+#define STORE4_PD(p, v) _mm256_storeu_pd((p), (v))
+#define LOAD8_PD(p) _mm512_loadu_pd(p)
+#define STORE8_PD(p, v) _mm512_storeu_pd((p), (v))
+#endif
+#endif
+
+/* The vectorized exp returns exactly 0 at or below this exponent, where 2^n would leave the normal range
+(libm's exp still returns subnormals down to about -745, all below 3e-308) */
+#define EXP_MIN_ARG (-708.0)
+
+/* exp(r) for |r| <= ln(2)/2 by a degree-11 Taylor polynomial, the truncation error r^12/12! is at most about 6e-15 */
+#define EXP_C2 (1.0 / 2)
+#define EXP_C3 (1.0 / 6)
+#define EXP_C4 (1.0 / 24)
+#define EXP_C5 (1.0 / 120)
+#define EXP_C6 (1.0 / 720)
+#define EXP_C7 (1.0 / 5040)
+#define EXP_C8 (1.0 / 40320)
+#define EXP_C9 (1.0 / 362880)
+#define EXP_C10 (1.0 / 3628800)
+#define EXP_C11 (1.0 / 39916800)
+#define LOG2E (1.4426950408889634)
+#define LN2_HI (0.693145751953125)
+#define LN2_LO (1.42860682030941723212e-6)
+
+/* Columns per tile: the tile's slice of the transposed points should stay in L1 while we sweep the rows */
+#define SIM_TILE_BYTES (16384)
+
+/* Rows evaluated before being mirrored: the block's cache lines in every row of the tile must stay in L1 */
+#define SIM_MIRROR_ROWS (32)
+
+static double sim_entry(double norm_i, double norm_j, double dot)
+{
+    /* Rounding may turn the distance of (nearly) identical points slightly negative */
+    double sq_euc_dist = norm_i + norm_j - 2 * dot;
+    if (sq_euc_dist < 0)
+        sq_euc_dist = 0;
+    return exp((-0.5) * sq_euc_dist);
+}
+
+static void sim_row_scalar(const REAL* xi, double norm_i, PMATRIX points_t, const double* norms, int j0, int j1, REAL* out)
+{
+    int j, c = 0;
+    int d = points_t->rows;
+    double dot = 0;
+
+    for (j = j0; j < j1; j++)
+    {
+        dot = 0;
+        for (c = 0; c < d; c++)
+            dot += (double)xi[c] * MAT_AT(points_t, c, j);
+        out[j] = (REAL)sim_entry(norm_i, norms[j], dot);
+    }
+}
+
+#ifdef SYMNMF_X86_SIMD
+__attribute__((target("avx2,fma")))
+static __m256d exp_avx2(__m256d x)
+{
+    __m256d n, r, p;
+    __m256d keep;
+    __m128i n32;
+    __m256i bits;
+
+    /* The lanes at or below EXP_MIN_ARG are computed clamped, and zeroed at the end */
+    keep = _mm256_cmp_pd(x, _mm256_set1_pd(EXP_MIN_ARG), _CMP_GT_OQ);
+    x = _mm256_max_pd(x, _mm256_set1_pd(EXP_MIN_ARG));
+
+    /* x = n*ln(2) + r */
+    n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_HI), x);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_LO), r);
+
+    /* e^r */
+    p = _mm256_set1_pd(EXP_C11);
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_C10));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_C9));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_C8));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_C7));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_C6));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_C5));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_C4));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_C3));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_C2));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0));
+
+    /* 2^n, built directly in the exponent bits */
+    n32 = _mm256_cvtpd_epi32(n);
+    bits = _mm256_slli_epi64(_mm256_add_epi64(_mm256_cvtepi32_epi64(n32), _mm256_set1_epi64x(1023)), 52);
+    return _mm256_and_pd(_mm256_mul_pd(p, _mm256_castsi256_pd(bits)), keep);
+}
+
+__attribute__((target("avx2,fma")))
+static void sim_row_avx2(const REAL* xi, double norm_i, PMATRIX points_t, const double* norms, int j0, int j1, REAL* out)
+{
+    int j, c = 0;
+    int d = points_t->rows;
+    __m256d dot, dist;
+    __m256d vnorm_i = _mm256_set1_pd(norm_i);
+
+    for (j = j0; j + 4 <= j1; j += 4)
+    {
+        dot = _mm256_setzero_pd();
+        for (c = 0; c < d; c++)
+            dot = _mm256_fmadd_pd(_mm256_set1_pd(xi[c]), LOAD4_PD(MAT_ROW(points_t, c) + j), dot);
+
+        dist = _mm256_add_pd(vnorm_i, _mm256_loadu_pd(norms + j));
+        dist = _mm256_fnmadd_pd(_mm256_set1_pd(2.0), dot, dist);
+        dist = _mm256_max_pd(dist, _mm256_setzero_pd());
+        STORE4_PD(out + j, exp_avx2(_mm256_mul_pd(dist, _mm256_set1_pd(-0.5))));
+    }
+
+    (void)sim_row_scalar(xi, norm_i, points_t, norms, j, j1, out);
+}
+
+__attribute__((target("avx512f")))
+static __m512d exp_avx512(__m512d x)
+{
+    __m512d n, r, p;
+    __mmask8 keep;
+
+    /* The lanes at or below EXP_MIN_ARG are computed clamped, and zeroed at the end */
+    keep = _mm512_cmp_pd_mask(x, _mm512_set1_pd(EXP_MIN_ARG), _CMP_GT_OQ);
+    x = _mm512_max_pd(x, _mm512_set1_pd(EXP_MIN_ARG));
+
+    /* x = n*ln(2) + r */
+    n = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    r = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_HI), x);
+    r = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_LO), r);
+
+    /* e^r */
+    p = _mm512_set1_pd(EXP_C11);
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_C10));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_C9));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_C8));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_C7));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_C6));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_C5));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_C4));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_C3));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_C2));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0));
+
+    /* p * 2^n */
+    return _mm512_maskz_scalef_pd(keep, p, n);
+}
+
+__attribute__((target("avx512f")))
+static void sim_row_avx512(const REAL* xi, double norm_i, PMATRIX points_t, const double* norms, int j0, int j1, REAL* out)
+{
+    int j, c = 0;
+    int d = points_t->rows;
+    __m512d dot, dist;
+    __m512d vnorm_i = _mm512_set1_pd(norm_i);
+
+    for (j = j0; j + 8 <= j1; j += 8)
+    {
+        dot = _mm512_setzero_pd();
+        for (c = 0; c < d; c++)
+            dot = _mm512_fmadd_pd(_mm512_set1_pd(xi[c]), LOAD8_PD(MAT_ROW(points_t, c) + j), dot);
+
+        dist = _mm512_add_pd(vnorm_i, _mm512_loadu_pd(norms + j));
+        dist = _mm512_fnmadd_pd(_mm512_set1_pd(2.0), dot, dist);
+        dist = _mm512_max_pd(dist, _mm512_setzero_pd());
+        STORE8_PD(out + j, exp_avx512(_mm512_mul_pd(dist, _mm512_set1_pd(-0.5))));
+    }
+
+    (void)sim_row_scalar(xi, norm_i, points_t, norms, j, j1, out);
+}
+#endif
+
+static SIM_ROW_KERNEL select_sim_kernel(void)
+{
+    /* SYMNMF_SIMD=scalar|avx2|avx512 caps the kernel, e.g. for comparing against the fallback */
+    char* cap = getenv("SYMNMF_SIMD");
+
+#ifdef SYMNMF_X86_SIMD
+    __builtin_cpu_init();
+    if ((cap == NULL || strcmp(cap, "avx512") == 0) && __builtin_cpu_supports("avx512f"))
+        return sim_row_avx512;
+    if ((cap == NULL || strcmp(cap, "avx512") == 0 || strcmp(cap, "avx2") == 0) &&
+        __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return sim_row_avx2;
+#else
+    (void)cap;
+#endif
+    return sim_row_scalar;
+}
+
+/* Written once by init_sim_kernel, before any other thread exists, and only read after that */
+static SIM_ROW_KERNEL selected_kernel = NULL;
+
+void init_sim_kernel(void)
+{
+    selected_kernel = select_sim_kernel();
+}
+
+SIM_ROW_KERNEL get_sim_kernel(void)
+{
+    /* Without init_sim_kernel every call selects again, which needs no shared state */
+    return (selected_kernel != NULL) ? selected_kernel : select_sim_kernel();
+}
+
+int prepare_points(PMATRIX points, PMATRIX* ppoints_t, double** pnorms)
+{
+    int status = -1;
+    int i, c = 0;
+    REAL* row = NULL;
+    double* norms = NULL;
+    PMATRIX points_t = NULL;
+
+    /* Columns of the transpose are contiguous points, so a SIMD load takes the same coord of consecutive points */
+    status = transpose_matrix(points, &points_t);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    norms = (double*)heap_alloc_aligned((size_t)points_t->stride * sizeof(double));
+    if (norms == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    for (i = 0; i < points->rows; i++)
+    {
+        row = MAT_ROW(points, i);
+        for (c = 0; c < points->cols; c++)
+            norms[i] += (double)row[c] * row[c];
+    }
+
+    /* Transfer ownership */
+    *ppoints_t = points_t;
+    points_t = NULL;
+    *pnorms = norms;
+    norms = NULL;
+
+    status = 0;
+
+lblCleanup:
+    free_matrix(points_t);
+    HEAPFREE(norms);
+    return status;
+}
+
+int sim_tile_columns(int d)
+{
+    /* Number of columns j whose coords (d elements each) fill a tile, rounded to whole cache lines */
+    int columns = SIM_TILE_BYTES / (int)sizeof(REAL) / (d > 0 ? d : 1);
+
+    columns -= columns % (int)MATRIX_ALIGN_ELEMENTS;
+    return (columns < (int)MATRIX_ALIGN_ELEMENTS) ? (int)MATRIX_ALIGN_ELEMENTS : columns;
+}
+
+static void sim_block(PMATRIX points, PMATRIX points_t, const double* norms, PMATRIX sim, double* degrees,
+    int i0, int i1, int j0, int j1, SIM_ROW_KERNEL kernel)
+{
+    /* Evaluates the rows i0..i1-1 of the column tile j0..j1-1 right of the diagonal,
+    then mirrors the block below the diagonal while its lines are still in L1 */
+    int i, j = 0;
+    int first = 0;
+    double row_sum = 0;
+    double column_sum = 0;
+    REAL* row = NULL;
+
+    /* Row i takes the columns of the tile right of the diagonal */
+    for (i = i0; i < i1; i++)
+    {
+        first = (i + 1 > j0) ? i + 1 : j0;
+        row = MAT_ROW(sim, i);
+        (void)kernel(MAT_ROW(points, i), norms[i], points_t, norms, first, j1, row);
+        row_sum = 0;
+        for (j = first; j < j1; j++)
+            row_sum += row[j];
+        degrees[i] += row_sum;
+    }
+
+    /* Column j of the block becomes row j, left of the diagonal */
+    for (j = (i0 + 1 > j0) ? i0 + 1 : j0; j < j1; j++)
+    {
+        row = MAT_ROW(sim, j);
+        column_sum = 0;
+        for (i = i0; i < i1 && i < j; i++)
+        {
+            row[i] = MAT_AT(sim, i, j);
+            column_sum += row[i];
+        }
+        degrees[j] += column_sum;
+    }
+}
+
+int pairwise_exp(PMATRIX points, PMATRIX sim, double* degrees)
+{
+    int status = -1;
+    int n = 0;
+    int i, i0, j0, j1 = 0;
+    int tile = 0;
+    double* norms = NULL;
+    double* sums = NULL; /* the degrees, or a scratch buffer when the caller doesn't need them */
+    PMATRIX points_t = NULL;
+    SIM_ROW_KERNEL kernel = get_sim_kernel();
+
+    n = points->rows;
+
+    status = prepare_points(points, &points_t, &norms);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    sums = (degrees != NULL) ? degrees : (double*)heap_alloc_aligned((size_t)n * sizeof(double));
+    if (sums == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    (void)memset(sums, 0, (size_t)n * sizeof(double));
+
+    /* Only the entries above the diagonal are evaluated, in blocks of SIM_MIRROR_ROWS rows of a column tile.
+    The blocks of a tile are shared between the threads (the work per block shrinks towards the diagonal,
+    so they are handed out dynamically), and each thread sums the degrees into a private copy */
+    tile = sim_tile_columns(points->cols);
+#pragma omp parallel private(i0, j0, j1) reduction(+:sums[:n])
+    for (j0 = 0; j0 < n; j0 += tile)
+    {
+        j1 = (n - j0 < tile) ? n : j0 + tile;
+#pragma omp for schedule(dynamic)
+        for (i0 = 0; i0 < j1 - 1; i0 += SIM_MIRROR_ROWS)
+            (void)sim_block(points, points_t, norms, sim, sums,
+                i0, (j1 - 1 - i0 < SIM_MIRROR_ROWS) ? j1 - 1 : i0 + SIM_MIRROR_ROWS, j0, j1, kernel);
+    }
+
+    /* The diagonal is defined as 0 */
+    for (i = 0; i < n; i++)
+        MAT_AT(sim, i, i) = 0;
+
+    status = 0;
+
+lblCleanup:
+    if (sums != degrees)
+        HEAPFREE(sums);
+    free_matrix(points_t);
+    HEAPFREE(norms);
+    return status;
+}
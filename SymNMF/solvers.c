@@ -0,0 +1,253 @@
+/* C Program: the accelerated solvers of symnmf, next to the multiplicative update of perform_iteration.
+Every solver is one SOLVER_STEP on the same SYMNMF_CONTEXT, so each iteration still costs one or two products
+with W (whatever its representation) and some O(n*k^2) work:
+- momentum_iteration: the multiplicative update, taken from H + w*(H - H_prev) with Nesterov's weights w. The
+  extrapolation is restarted (w = 0) whenever the residual grows.
+- hals_iteration and anls_iteration: min ||W - H*G^T||^2 + alpha*||H - G||^2 over H >= 0 and G >= 0, alternating
+  between H and G. Each half is a nonnegative least squares problem, separable over the rows: HALS takes one exact
+  step per column, ANLS a few projected gradient steps on the whole row. */
+#include "symnmf.h"
+
+static void extrapolate(PMATRIX current, PMATRIX previous, double weight, PMATRIX extrapolated)
+{
+    /* extrapolated = current + weight * (current - previous), entries that would leave the positive orthant keep
+    their current value (the multiplicative update can't bring back a zero) */
+    int i, j = 0;
+    double value = 0;
+    REAL* current_row = NULL;
+    REAL* previous_row = NULL;
+    REAL* extrapolated_row = NULL;
+
+#pragma omp parallel for schedule(static) private(j, value, current_row, previous_row, extrapolated_row)
+    for (i = 0; i < current->rows; i++)
+    {
+        current_row = MAT_ROW(current, i);
+        previous_row = MAT_ROW(previous, i);
+        extrapolated_row = MAT_ROW(extrapolated, i);
+        for (j = 0; j < current->cols; j++)
+        {
+            value = current_row[j] + weight * (current_row[j] - previous_row[j]);
+            extrapolated_row[j] = (REAL)((value > 0) ? value : current_row[j]);
+        }
+    }
+}
+
+int momentum_iteration(PSYMNMF_CONTEXT context, double* pdelta)
+{
+    int i, j = 0;
+    int n, k = 0;
+    double beta = context->params.beta;
+    double next_momentum = 0;
+    double last_residual = context->residual;
+    double delta = 0;
+    double trace = 0;
+    double diff = 0;
+    REAL* new_row = NULL;
+    REAL* current_row = NULL;
+    REAL* extrapolated_row = NULL;
+    REAL* numerator_row = NULL;
+    REAL* denominator_row = NULL;
+    PMATRIX current = context->h[context->current];
+    PMATRIX new = context->h[1 - context->current]; /* H(i-1) until the extrapolation is taken */
+    PMATRIX extrapolated = context->auxiliary;
+
+    n = current->rows;
+    k = current->cols;
+
+    /* Y = H(i) + (t_i - 1) / t_(i+1) * (H(i) - H(i-1)), the weight is 0 right after a (re)start */
+    next_momentum = (1 + sqrt(1 + 4 * context->momentum * context->momentum)) / 2;
+    (void)extrapolate(current, new, (context->momentum - 1) / next_momentum, extrapolated);
+
+    /* The multiplicative update from Y */
+    if (context->normalized.product(context->normalized.w, extrapolated, context->numerator, context->gemm_workspace) != 0 ||
+        gram(extrapolated, context->gram) != 0)
+        return 1;
+    (void)mult_small(extrapolated, context->gram, context->denominator);
+
+#pragma omp parallel for schedule(static) private(j, diff, new_row, current_row, extrapolated_row, numerator_row, denominator_row) reduction(+:delta, trace)
+    for (i = 0; i < n; i++)
+    {
+        new_row = MAT_ROW(new, i);
+        current_row = MAT_ROW(current, i);
+        extrapolated_row = MAT_ROW(extrapolated, i);
+        numerator_row = MAT_ROW(context->numerator, i);
+        denominator_row = MAT_ROW(context->denominator, i);
+        for (j = 0; j < k; j++)
+        {
+            new_row[j] = (REAL)calculate_cell(numerator_row[j], denominator_row[j], extrapolated_row[j], beta);
+            diff = new_row[j] - current_row[j];
+            delta += diff * diff;
+            trace += (double)extrapolated_row[j] * numerator_row[j];
+        }
+    }
+    context->residual = residual_from_trace(context, trace);
+
+    /* A step that made the residual grow restarts the sequence */
+    context->momentum = (context->residual > last_residual) ? 1 : next_momentum;
+
+    /* The new H becomes the current one */
+    context->current = 1 - context->current;
+    *pdelta = delta;
+
+    return 0;
+}
+
+static int prepare_half(PSYMNMF_CONTEXT context, PMATRIX fixed)
+{
+    /* W*F and F^T*F for the half that updates the other factor, F is the factor just updated so the half
+    sums its residual on the way */
+    if (context->normalized.product(context->normalized.w, fixed, context->numerator, context->gemm_workspace) != 0 ||
+        gram(fixed, context->gram) != 0)
+        return 1;
+    return 0;
+}
+
+static double hals_half(PSYMNMF_CONTEXT context, PMATRIX target, PMATRIX fixed)
+{
+    /* Column j of the target T given F: t_j = max(0, (W*f_j + alpha*f_j - sum over l != j of t_l*(F^T*F)_lj) / ((F^T*F)_jj + alpha)),
+    one column after the other. Row i of t_j depends only on row i of T, so the rows are split between the threads.
+    Returns ||T_new - T||^2, and leaves the residual of F in the context */
+    int i, j, l = 0;
+    int k = 0;
+    double alpha = context->params.split_penalty;
+    double value = 0;
+    double diff = 0;
+    double delta = 0;
+    double trace = 0;
+    REAL* target_row = NULL;
+    REAL* fixed_row = NULL;
+    REAL* wf_row = NULL;
+    PMATRIX ff = context->gram;
+
+    k = target->cols;
+
+#pragma omp parallel for schedule(static) private(j, l, value, diff, target_row, fixed_row, wf_row) reduction(+:delta, trace)
+    for (i = 0; i < target->rows; i++)
+    {
+        target_row = MAT_ROW(target, i);
+        fixed_row = MAT_ROW(fixed, i);
+        wf_row = MAT_ROW(context->numerator, i);
+        for (j = 0; j < k; j++)
+        {
+            value = wf_row[j] + alpha * fixed_row[j];
+            for (l = 0; l < k; l++)
+                if (l != j)
+                    value -= target_row[l] * MAT_AT(ff, l, j);
+            value /= MAT_AT(ff, j, j) + alpha;
+            value = (value > 0) ? value : 0;
+            diff = value - target_row[j];
+            delta += diff * diff;
+            target_row[j] = (REAL)value;
+            trace += (double)fixed_row[j] * wf_row[j];
+        }
+    }
+    context->residual = residual_from_trace(context, trace);
+
+    return delta;
+}
+
+int hals_iteration(PSYMNMF_CONTEXT context, double* pdelta)
+{
+    PMATRIX h = context->h[context->current];
+    PMATRIX g = context->auxiliary;
+
+    /* H given G, then G given the new H */
+    if (prepare_half(context, g) != 0)
+        return 1;
+    *pdelta = hals_half(context, h, g);
+
+    if (prepare_half(context, h) != 0)
+        return 1;
+    (void)hals_half(context, g, h);
+
+    return 0;
+}
+
+static double anls_half(PSYMNMF_CONTEXT context, PMATRIX target, PMATRIX fixed)
+{
+    /* Row i of the target T given F: min over t >= 0 of t*Q*t^T - 2*t*b_i^T for Q = F^T*F + alpha*I and
+    b_i = (W*F)_i + alpha*f_i. Projected gradient from the current row, with the step 1/L for L >= the largest
+    eigenvalue of Q (its largest absolute row sum). Returns ||T_new - T||^2, and leaves the residual of F in the context */
+    int i, j, l, step = 0;
+    int k = 0;
+    double alpha = context->params.split_penalty;
+    double lipschitz = 0;
+    double row_sum = 0;
+    double value = 0;
+    double diff = 0;
+    double delta = 0;
+    double trace = 0;
+    REAL* target_row = NULL;
+    REAL* fixed_row = NULL;
+    REAL* wf_row = NULL;
+    REAL* gradient_row = NULL;
+    PMATRIX ff = context->gram;
+
+    k = target->cols;
+
+    for (j = 0; j < k; j++)
+    {
+        row_sum = alpha;
+        for (l = 0; l < k; l++)
+            row_sum += fabs(MAT_AT(ff, j, l));
+        if (row_sum > lipschitz)
+            lipschitz = row_sum;
+    }
+
+    /* The buffers this solver doesn't use hold the gradients (denominator) and the starting rows, for delta (the other H) */
+#pragma omp parallel for schedule(static) private(j, l, step, value, diff, target_row, fixed_row, wf_row, gradient_row) reduction(+:delta, trace)
+    for (i = 0; i < target->rows; i++)
+    {
+        target_row = MAT_ROW(target, i);
+        fixed_row = MAT_ROW(fixed, i);
+        wf_row = MAT_ROW(context->numerator, i);
+        gradient_row = MAT_ROW(context->denominator, i);
+        for (j = 0; j < k; j++)
+        {
+            MAT_AT(context->h[1 - context->current], i, j) = target_row[j];
+            trace += (double)fixed_row[j] * wf_row[j];
+        }
+
+        for (step = 0; step < context->params.inner_steps; step++)
+        {
+            for (j = 0; j < k; j++)
+            {
+                value = alpha * (target_row[j] - fixed_row[j]) - wf_row[j];
+                for (l = 0; l < k; l++)
+                    value += target_row[l] * MAT_AT(ff, l, j);
+                gradient_row[j] = (REAL)value;
+            }
+            for (j = 0; j < k; j++)
+            {
+                value = target_row[j] - gradient_row[j] / lipschitz;
+                target_row[j] = (REAL)((value > 0) ? value : 0);
+            }
+        }
+
+        for (j = 0; j < k; j++)
+        {
+            diff = target_row[j] - MAT_AT(context->h[1 - context->current], i, j);
+            delta += diff * diff;
+        }
+    }
+    context->residual = residual_from_trace(context, trace);
+
+    return delta;
+}
+
+int anls_iteration(PSYMNMF_CONTEXT context, double* pdelta)
+{
+    PMATRIX h = context->h[context->current];
+    PMATRIX g = context->auxiliary;
+
+    /* H given G, then G given the new H */
+    if (prepare_half(context, g) != 0)
+        return 1;
+    *pdelta = anls_half(context, h, g);
+
+    if (prepare_half(context, h) != 0)
+        return 1;
+    (void)anls_half(context, g, h);
+
+    return 0;
+}
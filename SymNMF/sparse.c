@@ -0,0 +1,451 @@
+/* C Program: the sparse k-nearest-neighbor mode of symnmf.
+Instead of the dense nXn A, every point keeps only its knn most similar points (and/or those above
+a threshold), the graph is symmetrized, and A, D and W are kept in CSR form - O(n*knn) memory.
+W*H in the iterations becomes a sparse-dense product. */
+#include "symnmf.h"
+
+/* Initial capacity (in entries) of each thread's buffer of selected neighbors */
+#define TRIPLETS_INITIAL_CAPACITY (1024)
+
+typedef struct _TRIPLET
+{
+    int row;
+    int col;
+    REAL value;
+} TRIPLET;
+
+typedef struct _TRIPLETS
+{
+    TRIPLET* entries;
+    size_t count;
+    size_t capacity;
+} TRIPLETS;
+
+static int append_triplet(TRIPLETS* triplets, int row, int col, REAL value)
+{
+    TRIPLET* grown = NULL;
+    size_t capacity = 0;
+
+    if (triplets->count == triplets->capacity)
+    {
+        capacity = (triplets->capacity > 0) ? 2 * triplets->capacity : TRIPLETS_INITIAL_CAPACITY;
+        grown = (TRIPLET*)realloc(triplets->entries, capacity * sizeof(TRIPLET));
+        if (grown == NULL)
+            return 1;
+        triplets->entries = grown;
+        triplets->capacity = capacity;
+    }
+
+    triplets->entries[triplets->count].row = row;
+    triplets->entries[triplets->count].col = col;
+    triplets->entries[triplets->count].value = value;
+    triplets->count++;
+    return 0;
+}
+
+static void sift_down(TRIPLET* heap, int size, int i)
+{
+    /* Restores the min-heap (by value) below index i */
+    int smallest = i;
+    int child = 0;
+    TRIPLET temp;
+
+    while (1)
+    {
+        child = 2 * i + 1;
+        if (child < size && heap[child].value < heap[smallest].value)
+            smallest = child;
+        if (child + 1 < size && heap[child + 1].value < heap[smallest].value)
+            smallest = child + 1;
+        if (smallest == i)
+            break;
+        temp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = temp;
+        i = smallest;
+    }
+}
+
+static int select_neighbors(int i, const REAL* row, int n, int knn, double threshold, TRIPLET* heap, TRIPLETS* selected)
+{
+    /* Keeps the knn largest entries of row (without the diagonal) that are >= threshold, using a min-heap
+    whose root is the weakest neighbor kept so far. knn <= 0 keeps every entry >= threshold. Entries that
+    underflowed to 0 are never kept, so a far outlier gets no neighbors rather than zero-weight ones */
+    int j, h = 0;
+    int size = 0;
+
+    for (j = 0; j < n; j++)
+    {
+        if (j == i || row[j] <= 0 || row[j] < threshold)
+            continue;
+
+        if (knn <= 0)
+        {
+            if (append_triplet(selected, i, j, row[j]) != 0)
+                return 1;
+        }
+        else if (size < knn)
+        {
+            heap[size].row = i;
+            heap[size].col = j;
+            heap[size].value = row[j];
+            size++;
+
+            /* Heapify once it is full */
+            if (size == knn)
+                for (h = knn / 2 - 1; h >= 0; h--)
+                    (void)sift_down(heap, knn, h);
+        }
+        else if (row[j] > heap[0].value)
+        {
+            heap[0].col = j;
+            heap[0].value = row[j];
+            (void)sift_down(heap, knn, 0);
+        }
+    }
+
+    for (h = 0; h < size; h++)
+        if (append_triplet(selected, heap[h].row, heap[h].col, heap[h].value) != 0)
+            return 1;
+
+    return 0;
+}
+
+static int compare_columns(const void* a, const void* b)
+{
+    int col_a = ((const TRIPLET*)a)->col;
+    int col_b = ((const TRIPLET*)b)->col;
+    return (col_a > col_b) - (col_a < col_b);
+}
+
+static int build_symmetric_csr(int n, TRIPLETS* selected, int lists, PCSR_MATRIX* pcsr)
+{
+    /* A[i][j] is kept if j is a neighbor of i or i is a neighbor of j (the values are the same),
+    which makes the graph symmetric. Every selection is scattered to both rows, then deduplicated */
+    int status = -1;
+    int t, i = 0;
+    size_t e, p, q = 0;
+    size_t total = 0;
+    size_t* cursor = NULL;
+    TRIPLET* scattered = NULL;
+    TRIPLET* entry = NULL;
+    PCSR_MATRIX csr = NULL;
+
+    cursor = (size_t*)HEAPALLOCZ(cursor, (size_t)n + 1);
+    if (cursor == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* Count the entries of every row, both directions */
+    for (t = 0; t < lists; t++)
+    {
+        for (e = 0; e < selected[t].count; e++)
+        {
+            cursor[selected[t].entries[e].row + 1]++;
+            cursor[selected[t].entries[e].col + 1]++;
+        }
+        total += 2 * selected[t].count;
+    }
+    for (i = 0; i < n; i++)
+        cursor[i + 1] += cursor[i];
+
+    scattered = (TRIPLET*)HEAPALLOCZ(scattered, (total > 0) ? total : 1);
+    if (scattered == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    for (t = 0; t < lists; t++)
+    {
+        for (e = 0; e < selected[t].count; e++)
+        {
+            entry = &selected[t].entries[e];
+            scattered[cursor[entry->row]++] = *entry;
+            scattered[cursor[entry->col]].row = entry->col;
+            scattered[cursor[entry->col]].col = entry->row;
+            scattered[cursor[entry->col]++].value = entry->value;
+        }
+    }
+
+    /* Every cursor now points at the end of its row, i.e. at the start of the next one */
+    status = create_csr(n, n, total, &csr);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    q = 0;
+    for (i = 0; i < n; i++)
+    {
+        p = (i > 0) ? cursor[i - 1] : 0;
+        csr->row_ptr[i] = q;
+        qsort(scattered + p, cursor[i] - p, sizeof(TRIPLET), compare_columns);
+        for (; p < cursor[i]; p++)
+        {
+            if (q > csr->row_ptr[i] && csr->col_idx[q - 1] == scattered[p].col)
+                continue;
+            csr->col_idx[q] = scattered[p].col;
+            csr->values[q] = scattered[p].value;
+            q++;
+        }
+    }
+    csr->row_ptr[n] = q;
+    csr->nnz = q;
+
+    /* Transfer ownership */
+    *pcsr = csr;
+    csr = NULL;
+
+    status = 0;
+
+lblCleanup:
+    HEAPFREE(cursor);
+    HEAPFREE(scattered);
+    free_csr(csr);
+    return status;
+}
+
+int create_csr(int rows, int cols, size_t capacity, PCSR_MATRIX* pcsr)
+{
+    int status = -1;
+    PCSR_MATRIX csr = NULL;
+
+    csr = (PCSR_MATRIX)HEAPALLOCZ(csr, 1);
+    if (csr == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    csr->row_ptr = (size_t*)HEAPALLOCZ(csr->row_ptr, (size_t)rows + 1);
+    csr->col_idx = (int*)HEAPALLOCZ(csr->col_idx, (capacity > 0) ? capacity : 1);
+    csr->values = (REAL*)HEAPALLOCZ(csr->values, (capacity > 0) ? capacity : 1);
+    if (csr->row_ptr == NULL || csr->col_idx == NULL || csr->values == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    csr->rows = rows;
+    csr->cols = cols;
+
+    /* Transfer ownership */
+    *pcsr = csr;
+    csr = NULL;
+
+    status = 0;
+
+lblCleanup:
+    free_csr(csr);
+    return status;
+}
+
+void free_csr(PCSR_MATRIX csr)
+{
+    if (csr != NULL)
+    {
+        HEAPFREE(csr->row_ptr);
+        HEAPFREE(csr->col_idx);
+        HEAPFREE(csr->values);
+        HEAPFREE(csr);
+    }
+}
+
+int sym_knn(PMATRIX initial, int knn, double threshold, PCSR_MATRIX* psim, double** pdegrees)
+{
+    int status = -1;
+    int failed = 0;
+    int n = 0;
+    int i, t = 0;
+    int threads = 0;
+    size_t e = 0;
+    double* norms = NULL;
+    double* degrees = NULL;
+    REAL* rows = NULL; /* a scratch row of n similarities per thread */
+    TRIPLET* heaps = NULL; /* a heap of knn neighbors per thread */
+    TRIPLETS* selected = NULL; /* the neighbors selected by every thread */
+    PMATRIX points_t = NULL;
+    PCSR_MATRIX sim = NULL;
+    SIM_ROW_KERNEL kernel = get_sim_kernel();
+
+    n = initial->rows;
+    threads = get_thread_count();
+
+    status = prepare_points(initial, &points_t, &norms);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    rows = (REAL*)heap_alloc_aligned((size_t)threads * (size_t)points_t->stride * sizeof(REAL));
+    heaps = (TRIPLET*)HEAPALLOCZ(heaps, (size_t)threads * (size_t)((knn > 0) ? knn : 1));
+    selected = (TRIPLETS*)HEAPALLOCZ(selected, (size_t)threads);
+    degrees = (double*)heap_alloc_aligned((size_t)n * sizeof(double));
+    if (rows == NULL || heaps == NULL || selected == NULL || degrees == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* Every row is computed in full (vectorized), but only its neighbors are kept */
+#pragma omp parallel for schedule(dynamic, 64) num_threads(threads) private(t) reduction(|:failed)
+    for (i = 0; i < n; i++)
+    {
+        t = get_thread_index();
+        (void)kernel(MAT_ROW(initial, i), norms[i], points_t, norms, 0, n, rows + (size_t)t * points_t->stride);
+        failed |= select_neighbors(i, rows + (size_t)t * points_t->stride, n, knn, threshold,
+            heaps + (size_t)t * ((knn > 0) ? knn : 1), &selected[t]);
+    }
+    if (failed)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    status = build_symmetric_csr(n, selected, threads, &sim);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* ddg phase: the degrees are the row sums of the symmetric graph */
+    for (i = 0; i < n; i++)
+        for (e = sim->row_ptr[i]; e < sim->row_ptr[i + 1]; e++)
+            degrees[i] += sim->values[e];
+
+    /* Transfer ownership */
+    *psim = sim;
+    sim = NULL;
+    *pdegrees = degrees;
+    degrees = NULL;
+
+    status = 0;
+
+lblCleanup:
+    if (selected != NULL)
+        for (t = 0; t < threads; t++)
+            HEAPFREE(selected[t].entries);
+    HEAPFREE(selected);
+    HEAPFREE(heaps);
+    HEAPFREE(rows);
+    HEAPFREE(degrees);
+    HEAPFREE(norms);
+    free_matrix(points_t);
+    free_csr(sim);
+    return status;
+}
+
+void csr_norm_in_place(PCSR_MATRIX sim, double* degrees)
+{
+    /* W[i][j] = A[i][j] * d_i^(-1/2) * d_j^(-1/2) over the stored entries only.
+    A point without neighbors has degree 0 and gets the scale 0 (like stream.c), its row of W stays empty */
+    int i = 0;
+    size_t e = 0;
+
+    for (i = 0; i < sim->rows; i++)
+        degrees[i] = (degrees[i] > 0) ? pow(degrees[i], -0.5) : 0;
+
+#pragma omp parallel for schedule(static) private(e)
+    for (i = 0; i < sim->rows; i++)
+        for (e = sim->row_ptr[i]; e < sim->row_ptr[i + 1]; e++)
+            sim->values[e] = (REAL)(sim->values[e] * degrees[i] * degrees[sim->col_idx[e]]);
+}
+
+void spmm(PCSR_MATRIX W, PMATRIX H, PMATRIX WH)
+{
+    /* WH = W * H: every row of WH is the combination of the rows of H selected by the row of W */
+    int i, j = 0;
+    int k = 0;
+    size_t e = 0;
+    double w = 0;
+    REAL* h_row = NULL;
+    REAL* wh_row = NULL;
+
+    k = H->cols;
+
+#pragma omp parallel for schedule(static) private(j, e, w, h_row, wh_row)
+    for (i = 0; i < W->rows; i++)
+    {
+        wh_row = MAT_ROW(WH, i);
+        for (j = 0; j < k; j++)
+            wh_row[j] = 0;
+        for (e = W->row_ptr[i]; e < W->row_ptr[i + 1]; e++)
+        {
+            w = W->values[e];
+            h_row = MAT_ROW(H, W->col_idx[e]);
+            for (j = 0; j < k; j++)
+                wh_row[j] += w * h_row[j];
+        }
+    }
+}
+
+static int sparse_product(void* w, PMATRIX H, PMATRIX WH, PGEMM_WORKSPACE workspace)
+{
+    (void)workspace;
+    (void)spmm((PCSR_MATRIX)w, H, WH);
+    return 0;
+}
+
+static int sparse_squared_norm(void* w, double* pnorm)
+{
+    size_t e = 0;
+    double total = 0;
+    PCSR_MATRIX W = (PCSR_MATRIX)w;
+
+    for (e = 0; e < W->nnz; e++)
+        total += (double)W->values[e] * W->values[e];
+
+    *pnorm = total;
+    return 0;
+}
+
+void sparse_operator(PCSR_MATRIX normalized, PW_OPERATOR op)
+{
+    op->w = normalized;
+    op->product = sparse_product;
+    op->squared_norm = sparse_squared_norm;
+}
+
+int csr_to_dense(PCSR_MATRIX csr, PMATRIX* pdense)
+{
+    int status = -1;
+    int i = 0;
+    size_t e = 0;
+    PMATRIX dense = NULL;
+
+    status = create_matrix(csr->rows, csr->cols, &dense);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    for (i = 0; i < csr->rows; i++)
+        for (e = csr->row_ptr[i]; e < csr->row_ptr[i + 1]; e++)
+            MAT_AT(dense, i, csr->col_idx[e]) = csr->values[e];
+
+    /* Transfer ownership */
+    *pdense = dense;
+    dense = NULL;
+
+    status = 0;
+
+lblCleanup:
+    free_matrix(dense);
+    return status;
+}
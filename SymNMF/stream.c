@@ -0,0 +1,355 @@
+/* C Program: the incremental mode of symnmf, for points that keep arriving.
+Appending m points to n only evaluates the new rows of A (and mirrors them into the new columns) and adds their
+similarities to the old degrees: O(m*n*d) instead of the O(n^2*d) of sym. W = D^(-0.5)*A*D^(-0.5) is applied as
+D^(-0.5)*A*(D^(-0.5)*H), so the degrees that changed only change the scale vector, and A is never rewritten.
+The next fit resumes the iterations from the last H, so a small batch needs a few iterations instead of a run. */
+#include "symnmf.h"
+
+/* Rows allocated by the first append, later the capacity doubles */
+#define STREAM_MIN_CAPACITY (256)
+/* Rows of A that share the columns of the transposed points while they are in L1 */
+#define STREAM_BLOCK_ROWS (16)
+
+int create_stream(int d, int k, unsigned long seed, PSYMNMF_STREAM* pstream)
+{
+    int status = -1;
+    PSYMNMF_STREAM stream = NULL;
+
+    stream = (PSYMNMF_STREAM)HEAPALLOCZ(stream, 1);
+    if (stream == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    stream->d = d;
+    stream->k = k;
+    stream->seed = seed;
+
+    /* Transfer ownership */
+    *pstream = stream;
+    stream = NULL;
+
+    status = 0;
+
+lblCleanup:
+    free_stream(stream);
+    return status;
+}
+
+void free_stream(PSYMNMF_STREAM stream)
+{
+    if (stream != NULL)
+    {
+        free_matrix(stream->points);
+        free_matrix(stream->sim);
+        free_matrix(stream->h);
+        free_matrix(stream->scaled_h);
+        HEAPFREE(stream->degrees);
+        HEAPFREE(stream->scale);
+        HEAPFREE(stream);
+    }
+}
+
+static int grow_stream(PSYMNMF_STREAM stream, int needed)
+{
+    /* Moves the state to buffers of at least needed rows, doubling so n appends copy O(n^2) entries in total */
+    int status = -1;
+    int i = 0;
+    int n = stream->n;
+    int capacity = 0;
+    double* degrees = NULL;
+    double* scale = NULL;
+    PMATRIX points = NULL;
+    PMATRIX sim = NULL;
+
+    capacity = (stream->capacity > 0) ? 2 * stream->capacity : STREAM_MIN_CAPACITY;
+    if (capacity < needed)
+        capacity = needed;
+
+    degrees = (double*)HEAPALLOCZ(degrees, (size_t)capacity);
+    scale = (double*)HEAPALLOCZ(scale, (size_t)capacity);
+    if (degrees == NULL || scale == NULL ||
+        create_matrix(capacity, stream->d, &points) != 0 ||
+        create_matrix(capacity, capacity, &sim) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    if (n > 0)
+    {
+        (void)memcpy(points->data, stream->points->data, (size_t)n * (size_t)points->stride * sizeof(REAL));
+        (void)memcpy(degrees, stream->degrees, (size_t)n * sizeof(double));
+        (void)memcpy(scale, stream->scale, (size_t)n * sizeof(double));
+    }
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < n; i++)
+        (void)memcpy(MAT_ROW(sim, i), MAT_ROW(stream->sim, i), (size_t)n * sizeof(REAL));
+
+    /* The used part keeps its size, the rest is room */
+    points->rows = n;
+    sim->rows = n;
+    sim->cols = n;
+
+    free_matrix(stream->points);
+    free_matrix(stream->sim);
+    HEAPFREE(stream->degrees);
+    HEAPFREE(stream->scale);
+
+    /* Transfer ownership */
+    stream->points = points;
+    stream->sim = sim;
+    stream->degrees = degrees;
+    stream->scale = scale;
+    stream->capacity = capacity;
+    points = NULL;
+    sim = NULL;
+    degrees = NULL;
+    scale = NULL;
+
+    status = 0;
+
+lblCleanup:
+    free_matrix(points);
+    free_matrix(sim);
+    HEAPFREE(degrees);
+    HEAPFREE(scale);
+    return status;
+}
+
+int stream_append(PSYMNMF_STREAM stream, PMATRIX points)
+{
+    int status = -1;
+    int i, i0, i1, j, j0, j1 = 0;
+    int n0 = stream->n;
+    int n1 = stream->n + points->rows;
+    int columns = 0;
+    double row_sum = 0;
+    double* norms = NULL;
+    REAL* row = NULL;
+    PMATRIX points_t = NULL;
+    PMATRIX sim = NULL;
+    SIM_ROW_KERNEL kernel = get_sim_kernel();
+
+    if (points->cols != stream->d)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    if (n1 > stream->capacity && grow_stream(stream, n1) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    sim = stream->sim;
+
+    for (i = n0; i < n1; i++)
+        (void)memcpy(MAT_ROW(stream->points, i), MAT_ROW(points, i - n0), (size_t)points->cols * sizeof(REAL));
+    stream->points->rows = n1;
+    sim->rows = n1;
+    sim->cols = n1;
+
+    status = prepare_points(stream->points, &points_t, &norms);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* The new rows of A, whole (their diagonal is 0), and their degrees */
+    columns = sim_tile_columns(points->cols);
+#pragma omp parallel for schedule(dynamic) private(i, i1, j, j0, j1, row, row_sum)
+    for (i0 = n0; i0 < n1; i0 += STREAM_BLOCK_ROWS)
+    {
+        i1 = (n1 - i0 < STREAM_BLOCK_ROWS) ? n1 : i0 + STREAM_BLOCK_ROWS;
+        for (j0 = 0; j0 < n1; j0 += columns)
+        {
+            j1 = (n1 - j0 < columns) ? n1 : j0 + columns;
+            for (i = i0; i < i1; i++)
+                (void)kernel(MAT_ROW(stream->points, i), norms[i], points_t, norms, j0, j1, MAT_ROW(sim, i));
+        }
+
+        for (i = i0; i < i1; i++)
+        {
+            row = MAT_ROW(sim, i);
+            row[i] = 0;
+            row_sum = 0;
+            for (j = 0; j < n1; j++)
+                row_sum += row[j];
+            stream->degrees[i] = row_sum;
+        }
+    }
+
+    /* Their columns in the old rows, which also gain the new similarities in their degrees */
+#pragma omp parallel for schedule(static) private(i, row, row_sum)
+    for (j = 0; j < n0; j++)
+    {
+        row = MAT_ROW(sim, j);
+        row_sum = 0;
+        for (i = n0; i < n1; i++)
+        {
+            row[i] = MAT_AT(sim, i, j);
+            row_sum += row[i];
+        }
+        stream->degrees[j] += row_sum;
+    }
+
+    /* A point without similarities (alone, or isolated) gets no weight at all, like in nystrom.c */
+    for (i = 0; i < n1; i++)
+        stream->scale[i] = (stream->degrees[i] > 0) ? pow(stream->degrees[i], -0.5) : 0;
+    stream->n = n1;
+
+    status = 0;
+
+lblCleanup:
+    free_matrix(points_t);
+    HEAPFREE(norms);
+    return status;
+}
+
+static int stream_product(void* w, PMATRIX H, PMATRIX WH, PGEMM_WORKSPACE workspace)
+{
+    PSYMNMF_STREAM stream = (PSYMNMF_STREAM)w;
+
+    /* The scratch follows the shape of H */
+    if (stream->scaled_h != NULL && (stream->scaled_h->rows != H->rows || stream->scaled_h->cols != H->cols))
+    {
+        free_matrix(stream->scaled_h);
+        stream->scaled_h = NULL;
+    }
+    if (stream->scaled_h == NULL && create_matrix(H->rows, H->cols, &stream->scaled_h) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+
+    (void)scale_rows(H, stream->scale, stream->scaled_h);
+    if (gemm(stream->sim, stream->scaled_h, WH, workspace) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+    (void)scale_rows(WH, stream->scale, WH);
+    return 0;
+}
+
+static int stream_squared_norm(void* w, double* pnorm)
+{
+    /* The sum of (a_ij * s_i * s_j)^2 */
+    int i, j = 0;
+    double row_sum = 0;
+    double total = 0;
+    REAL* row = NULL;
+    PSYMNMF_STREAM stream = (PSYMNMF_STREAM)w;
+
+#pragma omp parallel for schedule(static) private(j, row, row_sum) reduction(+:total)
+    for (i = 0; i < stream->n; i++)
+    {
+        row = MAT_ROW(stream->sim, i);
+        row_sum = 0;
+        for (j = 0; j < stream->n; j++)
+            row_sum += (row[j] * stream->scale[j]) * (row[j] * stream->scale[j]);
+        total += row_sum * stream->scale[i] * stream->scale[i];
+    }
+
+    *pnorm = total;
+    return 0;
+}
+
+void stream_operator(PSYMNMF_STREAM stream, PW_OPERATOR op)
+{
+    op->w = stream;
+    op->product = stream_product;
+    op->squared_norm = stream_squared_norm;
+}
+
+static int warm_start(PSYMNMF_STREAM stream, PMATRIX* pinitial_h)
+{
+    /* The last H for the points it has, and for the new points rows drawn from U[0, 2*mean of the column),
+    so they start at the scale of the rows they join. The draws are seeded by the seed and the old n */
+    int status = -1;
+    int i, j = 0;
+    int old_n = stream->h->rows;
+    int k = stream->k;
+    double* means = NULL;
+    RANDOM_STATE state;
+    PMATRIX initial_h = NULL;
+
+    means = (double*)HEAPALLOCZ(means, (size_t)k);
+    if (means == NULL || create_matrix(stream->n, k, &initial_h) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    for (i = 0; i < old_n; i++)
+    {
+        (void)memcpy(MAT_ROW(initial_h, i), MAT_ROW(stream->h, i), (size_t)k * sizeof(REAL));
+        for (j = 0; j < k; j++)
+            means[j] += MAT_AT(stream->h, i, j);
+    }
+
+    (void)seed_random(&state, stream->seed + (unsigned long)old_n);
+    for (i = old_n; i < stream->n; i++)
+        for (j = 0; j < k; j++)
+            MAT_AT(initial_h, i, j) = (REAL)(2 * means[j] / old_n * next_random_double(&state));
+
+    /* Transfer ownership */
+    *pinitial_h = initial_h;
+    initial_h = NULL;
+
+    status = 0;
+
+lblCleanup:
+    free_matrix(initial_h);
+    HEAPFREE(means);
+    return status;
+}
+
+int stream_fit(PSYMNMF_STREAM stream, PSYMNMF_PARAMS params, PSOLVER_REPORT report)
+{
+    int status = -1;
+    int i = 0;
+    int connected = 0; /* initialized to False */
+    PMATRIX initial_h = NULL;
+    PMATRIX updated_h = NULL;
+    W_OPERATOR op;
+
+    /* W = 0 (a single point, or only isolated ones) would start H at 0, where the update is 0/0 */
+    for (i = 0; i < stream->n && !connected; i++)
+        connected = (stream->degrees[i] > 0);
+    if (!connected)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+    (void)stream_operator(stream, &op);
+
+    /* The first fit starts like symnmf_fit, the next ones from the H before */
+    if (stream->h == NULL)
+        status = initialize_h(&op, stream->n, stream->k, stream->seed, &initial_h);
+    else
+        status = warm_start(stream, &initial_h);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        return status;
+    }
+
+    status = symnmf_solve_with(&op, initial_h, params, &updated_h, report);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        return status;
+    }
+
+    free_matrix(stream->h);
+    stream->h = updated_h;
+    return 0;
+}
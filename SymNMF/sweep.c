@@ -0,0 +1,258 @@
+/* C Program: choosing k. W is computed once and factorized for k_min..k_max. The first k starts like symnmf_fit, every
+next one from the H of the k before it with its largest cluster split in two, so a k costs about its iterations alone.
+With cold_starts, every k after the first is also solved from a cold start like symnmf_fit, and keeps the H of the lower
+residual (a warm start can settle in a worse local minimum than a cold one, and the other way around), at about twice
+the iterations. Each k is scored by the euclidean silhouette (silhouette.c) of its clusters, the argmax of every row
+of H, over the points. Distances, unlike the affinities of W (about 0 between any two clusters that are apart), tell a
+cluster cut in two from two clusters merged into one. */
+#include "symnmf.h"
+
+/* The share of h_ic a split leaves on the side a row didn't go to, the multiplicative update never brings back a 0 */
+#define SWEEP_SPLIT_LEAK (0.1)
+
+static int compare_descending(const void* first, const void* second)
+{
+    double a = *(const double*)first;
+    double b = *(const double*)second;
+    return (a < b) - (a > b);
+}
+
+static int split_largest_cluster(PW_OPERATOR normalized, PMATRIX previous, unsigned long seed, PMATRIX next)
+{
+    /* next = previous with its largest argmax cluster c split in two by membership: a random member p of c, and the half
+    of c of the largest affinity to p, move to a new last column; the rest of c stays in column c. Splitting along W
+    cuts a merged cluster between the clusters it merged, instead of cutting through a real one */
+    int status = -1;
+    int i = 0;
+    int n = previous->rows;
+    int k = previous->cols;
+    int largest = 0;
+    int pivot = 0;
+    int chosen = 0;
+    int members = 0;
+    int moved = 0;
+    int* labels = NULL;
+    int* sizes = NULL;
+    double threshold = HUGE_VAL;
+    double h = 0;
+    double* ranked = NULL;
+    RANDOM_STATE state;
+    PMATRIX indicator = NULL;
+    PMATRIX affinities = NULL;
+
+    labels = (int*)HEAPALLOCZ(labels, (size_t)n + 1);
+    sizes = (int*)HEAPALLOCZ(sizes, (size_t)k);
+    ranked = (double*)HEAPALLOCZ(ranked, (size_t)n + 1);
+    if (labels == NULL || sizes == NULL || ranked == NULL ||
+        create_matrix(n, 1, &indicator) != 0 ||
+        create_matrix(n, 1, &affinities) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* The largest cluster (the first one on ties), and a random member of it */
+    (void)assign_clusters(previous, labels);
+    for (i = 0; i < n; i++)
+        sizes[labels[i]]++;
+    for (i = 1; i < k; i++)
+        if (sizes[i] > sizes[largest])
+            largest = i;
+    members = sizes[largest];
+    (void)seed_random(&state, seed + (unsigned long)k);
+    chosen = (int)(next_random_double(&state) * members);
+    for (pivot = 0; labels[pivot] != largest || chosen-- > 0; pivot++)
+        ;
+
+    /* Column p of W, p being the most similar to itself (the diagonal of W is 0) */
+    MAT_AT(indicator, pivot, 0) = 1;
+    status = normalized->product(normalized->w, indicator, affinities, NULL);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+    MAT_AT(affinities, pivot, 0) = (REAL)HUGE_VAL;
+
+    /* The affinity of the (members / 2)-th most similar member */
+    for (i = 0, chosen = 0; i < n; i++)
+        if (labels[i] == largest)
+            ranked[chosen++] = MAT_AT(affinities, i, 0);
+    qsort(ranked, (size_t)members, sizeof(double), compare_descending);
+    if (members >= 2)
+        threshold = ranked[members / 2 - 1];
+
+    for (i = 0; i < n; i++)
+    {
+        (void)memcpy(MAT_ROW(next, i), MAT_ROW(previous, i), (size_t)k * sizeof(REAL));
+        h = MAT_AT(previous, i, largest);
+        if (labels[i] == largest && moved < members / 2 && MAT_AT(affinities, i, 0) >= threshold)
+        {
+            MAT_AT(next, i, k) = (REAL)h;
+            MAT_AT(next, i, largest) = (REAL)(h * SWEEP_SPLIT_LEAK);
+            moved++;
+        }
+        else
+            MAT_AT(next, i, k) = (REAL)(h * SWEEP_SPLIT_LEAK);
+    }
+
+    status = 0;
+
+lblCleanup:
+    HEAPFREE(labels);
+    HEAPFREE(sizes);
+    HEAPFREE(ranked);
+    free_matrix(indicator);
+    free_matrix(affinities);
+    return status;
+}
+
+static int score_clusters(PMATRIX initial, PMATRIX H, double* pscore)
+{
+    /* The mean silhouette of the argmax clusters of H over the points. It is undefined for a single cluster
+    (or n of them), which scores 0 */
+    int status = -1;
+    int i = 0;
+    int n = H->rows;
+    int clusters = 0;
+    int* labels = NULL;
+    int* sizes = NULL;
+
+    labels = (int*)HEAPALLOCZ(labels, (size_t)n + 1);
+    sizes = (int*)HEAPALLOCZ(sizes, (size_t)H->cols);
+    if (labels == NULL || sizes == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    (void)assign_clusters(H, labels);
+    for (i = 0; i < n; i++)
+        if (sizes[labels[i]]++ == 0)
+            clusters++;
+
+    *pscore = 0;
+    status = (clusters < 2 || clusters > n - 1) ? 0 : silhouette(initial, labels, H->cols, pscore);
+    if (status != 0)
+        printf("An Error Has Occurred\n");
+
+lblCleanup:
+    HEAPFREE(labels);
+    HEAPFREE(sizes);
+    return status;
+}
+
+int symnmf_sweep(PMATRIX initial, int k_min, int k_max, unsigned long seed, int cold_starts, PMATRIX* hs, PSWEEP_RESULT results)
+{
+    /* hs and results have k_max - k_min + 1 entries, one per k. The first k starts like symnmf_fit */
+    int status = -1;
+    int k = 0;
+    int n = 0;
+    double mean = 0;
+    double* degrees = NULL;
+    PMATRIX sim = NULL;
+    PMATRIX initial_h = NULL;
+    PMATRIX warm_h = NULL;
+    PMATRIX cold_h = NULL;
+    SYMNMF_PARAMS params;
+    SOLVER_REPORT warm_report;
+    SOLVER_REPORT cold_report;
+    W_OPERATOR op;
+
+    n = initial->rows;
+    if (k_min < 1 || k_max < k_min || k_max > n)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+    for (k = k_min; k <= k_max; k++)
+        hs[k - k_min] = NULL;
+
+    /* sym, ddg and norm once for all the k */
+    status = sym_ddg(initial, &sim, &degrees);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+    mean = norm_in_place(sim, degrees) / ((double)n * (double)n);
+    (void)dense_operator(sim, &op);
+    (void)default_params(&params);
+
+    for (k = k_min; k <= k_max; k++)
+    {
+        /* The warm start, from the split of the k before */
+        if (k > k_min)
+        {
+            status = create_matrix(n, k, &initial_h);
+            if (status == 0)
+                status = split_largest_cluster(&op, hs[k - 1 - k_min], seed, initial_h);
+            if (status == 0)
+            {
+                status = symnmf_solve_with(&op, initial_h, &params, &warm_h, &warm_report);
+                initial_h = NULL;
+            }
+            if (status != 0)
+            {
+                printf("An Error Has Occurred\n");
+                goto lblCleanup;
+            }
+        }
+
+        /* The cold start, of the first k and, with cold_starts, of every k */
+        if (k == k_min || cold_starts)
+        {
+            status = create_matrix(n, k, &initial_h);
+            if (status == 0)
+            {
+                (void)fill_uniform(initial_h, 2 * sqrt(mean / k), seed);
+                status = symnmf_solve_with(&op, initial_h, &params, &cold_h, &cold_report);
+                initial_h = NULL;
+            }
+            if (status != 0)
+            {
+                printf("An Error Has Occurred\n");
+                goto lblCleanup;
+            }
+        }
+
+        /* Keep the lower residual, the warm start on ties. Transfer ownership */
+        results[k - k_min].k = k;
+        results[k - k_min].warm_started = (warm_h != NULL && (cold_h == NULL || warm_report.residual <= cold_report.residual));
+        results[k - k_min].report = results[k - k_min].warm_started ? warm_report : cold_report;
+        hs[k - k_min] = results[k - k_min].warm_started ? warm_h : cold_h;
+        if (results[k - k_min].warm_started)
+            warm_h = NULL;
+        else
+            cold_h = NULL;
+        free_matrix(warm_h);
+        free_matrix(cold_h);
+        warm_h = NULL;
+        cold_h = NULL;
+
+        status = score_clusters(initial, hs[k - k_min], &results[k - k_min].score);
+        if (status != 0)
+        {
+            printf("An Error Has Occurred\n");
+            goto lblCleanup;
+        }
+    }
+
+    status = 0;
+
+lblCleanup:
+    if (status != 0)
+        for (k = k_min; k <= k_max; k++)
+        {
+            free_matrix(hs[k - k_min]);
+            hs[k - k_min] = NULL;
+        }
+    free_matrix(initial_h);
+    free_matrix(warm_h);
+    free_matrix(cold_h);
+    free_matrix(sim);
+    HEAPFREE(degrees);
+    return status;
+}
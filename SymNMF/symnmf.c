@@ -2,23 +2,23 @@
 implementation of the symnmf algorithm's different steps. */
 #include "symnmf.h"
 
-double find_sq_euc_dist(double* point1, double* point2, int d) /* finds squared euclidian distance between two points of dimension d */
+double find_sq_euc_dist(REAL* point1, REAL* point2, int d) /* finds squared euclidian distance between two points of dimension d */
 {
     /* Iterates over coordinates of point1 and point 2, calculates the square of their difference and adds to sum*/
     double total = 0;
-    double squared_diff = 0;
+    double diff = 0;
     int i = 0;
 
     for (i = 0; i < d; i++)
     {
-        squared_diff = pow(point1[i] - point2[i], 2);
-        total += squared_diff;
+        diff = point1[i] - point2[i];
+        total += diff * diff;
     }
 
     return total;
 }
 
-double find_exp(double* point1, double* point2, int d) /* finds the exp function as described in algorithm: e^( - sq_euc_dist / 2) */
+double find_exp(REAL* point1, REAL* point2, int d) /* finds the exp function as described in algorithm: e^( - sq_euc_dist / 2) */
 {
     double sq_euc_dist = 0;
     double res = 0;
@@ -32,16 +32,10 @@ double find_exp(double* point1, double* point2, int d) /* finds the exp function
 int mat_mult(PMATRIX A, PMATRIX B, PMATRIX* pres) /* */
 {
     int status = -1;
-    int n, k, m = 0;
-    int i, j, x = 0;
     PMATRIX res = NULL;
 
-    n = A->rows;
-    k = A->cols;
-    m = B->cols; 
-
     /* Allocate a zero-ed matrix nXm */
-    status = create_matrix(n, m, &res);
+    status = create_matrix(A->rows, B->cols, &res);
     if (status != 0)
     {
         printf("An Error Has Occurred\n");
@@ -49,11 +43,14 @@ int mat_mult(PMATRIX A, PMATRIX B, PMATRIX* pres) /* */
         goto lblCleanup;
     }
     
-    /* Fill the values */
-    for (i = 0; i < n; i++)
-        for (j = 0; j < m; j++)
-            for (x = 0; x < k; x++)
-                res->coords[i][j] += A->coords[i][x] * B->coords[x][j];  /* Perform the matrix multiplication */ 
+    /* Perform the matrix multiplication with the blocked engine */
+    status = gemm(A, B, res, NULL);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
 
     /* Transfer ownership */
     *pres = res;
@@ -66,14 +63,44 @@ lblCleanup:
     return status;
 }
 
-int subtract_matrices(PMATRIX A, PMATRIX B, PMATRIX* pres)
+double calculate_cell(double numerator, double denominator, double H_ij, double beta)
 {
-    int status = -1;
+    double result = 0;
+    result = H_ij * (1 - beta + ((beta)*(numerator/denominator)));
+    return result;
+}
+
+double squared_frob_norm(PMATRIX A, PMATRIX B)
+{
+    /* Assumes that matrices are of same dimensions, the difference is never stored */
     int i, j = 0;
-    PMATRIX res = NULL;
-    
-    /* Allocate a zero-ed matrix nXm */
-    status = create_matrix(A->rows, A->cols, &res);
+    double diff = 0;
+    double result = 0;
+    REAL* a_row = NULL;
+    REAL* b_row = NULL;
+
+#pragma omp parallel for schedule(static) private(j, diff, a_row, b_row) reduction(+:result)
+    for (i = 0; i < A->rows; i++)
+    {
+        a_row = MAT_ROW(A, i);
+        b_row = MAT_ROW(B, i);
+        for (j = 0; j < A->cols; j++)
+        {
+            diff = a_row[j] - b_row[j];
+            result += diff * diff;
+        }
+    }
+
+    return result;
+}
+
+int sym(PMATRIX initial, PMATRIX* psim)
+{
+    int status = -1;
+    PMATRIX sim = NULL;
+
+    /* Allocate a zero-ed matrix nXn */
+    status = create_matrix(initial->rows, initial->rows, &sim);
     if (status != 0)
     {
         printf("An Error Has Occurred\n");
@@ -81,251 +108,745 @@ int subtract_matrices(PMATRIX A, PMATRIX B, PMATRIX* pres)
         goto lblCleanup;
     }
     
-    /* Fill the values */
-    for (i = 0; i < A->rows; i++)
-        for (j = 0; j < A->cols; j++)
-            res->coords[i][j] = A->coords[i][j] - B->coords[i][j];  /* Perform the matrix subtraction */ 
+    /* Fill the values with the vectorized engine, the degrees aren't needed */
+    status = pairwise_exp(initial, sim, NULL);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
 
     /* Transfer ownership */
-    *pres = res;
-    res = NULL;
+    *psim = sim;
+    sim = NULL;
 
     status = 0;
 
 lblCleanup:
-    free_matrix(res);
+    free_matrix(sim);
     return status;
 }
 
-void pow_diag(PMATRIX M, double a)
+int sym_ddg(PMATRIX initial, PMATRIX* psim, double** pdegrees)
 {
+    int status = -1;
     int n = 0;
-    int i = 0;
+    double* degrees = NULL;
+    PMATRIX sim = NULL;
+
+    n = initial->rows;
+
+    /* Allocate a zero-ed matrix nXn, and the diagonal of D */
+    status = create_matrix(n, n, &sim);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    degrees = (double*)heap_alloc_aligned((size_t)n * sizeof(double));
+    if (degrees == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* Every pair is evaluated once, and added to both of its rows' degrees on the way */
+    status = pairwise_exp(initial, sim, degrees);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* Transfer ownership */
+    *psim = sim;
+    sim = NULL;
+    *pdegrees = degrees;
+    degrees = NULL;
 
-    n = M->rows;
+    status = 0;
+
+lblCleanup:
+    free_matrix(sim);
+    HEAPFREE(degrees);
+    return status;
+}
 
+int ddg(PMATRIX sim, PMATRIX* pdiagonal)/* A -> D */
+{
+    int status = -1;
+    int i, j = 0;
+    int n = 0;
+    REAL* row = NULL;
+    double* degrees = NULL;
+
+    n = sim->rows;
+
+    degrees = (double*)heap_alloc_aligned((size_t)n * sizeof(double));
+    if (degrees == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    
+    /* Sum the rows of sim */
     for (i = 0; i < n; i++)
-        M->coords[i][i] = pow(M->coords[i][i], a);
+    {
+        row = MAT_ROW(sim, i);
+        for (j = 0; j < n; j++)
+            degrees[i] += row[j];
+    }
+
+    status = diagonal_from_degrees(degrees, n, pdiagonal);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    status = 0;
+
+lblCleanup:
+    HEAPFREE(degrees);
+    return status;
 }
 
-double calculate_cell(double numerator, double denominator, double H_ij, double beta)
+double norm_in_place(PMATRIX sim, double* degrees)
 {
-    double result = 0;
-    result = H_ij * (1 - beta + ((beta)*(numerator/denominator)));
-    return result;
+    /* W[i][j] = A[i][j] * d_i^(-1/2) * d_j^(-1/2), which is D^(-1/2) * A * D^(-1/2) without forming D.
+    The sum of W comes on the way, for the initialization of H */
+    int i, j = 0;
+    int n = 0;
+    double scale_i = 0;
+    double total = 0;
+    REAL* row = NULL;
+
+    n = sim->rows;
+
+    /* Turn the degrees into the diagonal of D^(-0.5) */
+    for (i = 0; i < n; i++)
+        degrees[i] = pow(degrees[i], -0.5);
+
+#pragma omp parallel for schedule(static) private(j, row, scale_i) reduction(+:total)
+    for (i = 0; i < n; i++)
+    {
+        row = MAT_ROW(sim, i);
+        scale_i = degrees[i];
+        for (j = 0; j < n; j++)
+        {
+            row[j] = (REAL)(row[j] * scale_i * degrees[j]);
+            total += row[j];
+        }
+    }
+
+    return total;
 }
 
-int squared_frob_norm(PMATRIX A, PMATRIX B, double* presult)
+int norm(PMATRIX sim, PMATRIX diagonal, PMATRIX* pnormalized)
 {
     int status = -1;
-    int i, j = 0;
-    double result = 0;
-    PMATRIX sub = NULL;
-    
-    /* Allocate a zero-ed matrix nXm */
-    status = subtract_matrices(A, B, &sub);
+    int i = 0;
+    int n = 0;
+    double* degrees = NULL;
+    PMATRIX res = NULL; /* Will store end result */
+
+    n = sim->rows;
+
+    /* Copy A and the diagonal of D, so the caller's matrices are left untouched */
+    status = create_matrix(n, n, &res);
     if (status != 0)
     {
         printf("An Error Has Occurred\n");
         status = 1;
         goto lblCleanup;
     }
-    
-    /* Calculate the final result */
-    for (i = 0; i < sub->rows; i++)
-        for (j = 0; j < sub->cols; j++)
-            result += pow(sub->coords[i][j], 2);
+    (void)memcpy(res->data, sim->data, (size_t)n * (size_t)sim->stride * sizeof(REAL));
+
+    degrees = (double*)heap_alloc_aligned((size_t)n * sizeof(double));
+    if (degrees == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    for (i = 0; i < n; i++)
+        degrees[i] = MAT_AT(diagonal, i, i);
+
+    /* Computing W */
+    (void)norm_in_place(res, degrees);
 
-    /* Transfer result */
-    *presult = result;
+    /* Transfer ownership */
+    *pnormalized = res;
+    res = NULL;
 
     status = 0;
 
 lblCleanup:
-    free_matrix(sub);
+    HEAPFREE(degrees);
+    free_matrix(res);
     return status;
 }
 
-int sym(PMATRIX initial, PMATRIX* psim)
+int symnmf(PMATRIX initial_h, PMATRIX normalized, PMATRIX* pupdated_h)
+{
+    W_OPERATOR op;
+
+    (void)dense_operator(normalized, &op);
+    return symnmf_solve(&op, initial_h, pupdated_h);
+}
+
+int symnmf_fit(PMATRIX initial, int k, unsigned long seed, PMATRIX* ph, PMATRIX* pnormalized)
 {
+    /* The whole pipeline on the C side, W never leaves it unless asked for (pnormalized may be NULL) */
     int status = -1;
-    int i, j = 0;
-    int n, d = 0;
+    int n = 0;
+    double mean = 0;
+    double* degrees = NULL;
     PMATRIX sim = NULL;
+    PMATRIX initial_h = NULL;
+    PMATRIX updated_h = NULL;
 
     n = initial->rows;
-    d = initial->cols;
 
-    /* Allocate a zero-ed matrix nXn */
-    status = create_matrix(n, n, &sim);
+    /* sym and ddg phases in one pass, then norm in place */
+    status = sym_ddg(initial, &sim, &degrees);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+    mean = norm_in_place(sim, degrees) / ((double)n * (double)n);
+
+    /* H_0 ~ U[0, 2 * sqrt(mean(W) / k)) */
+    status = create_matrix(n, k, &initial_h);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+    (void)fill_uniform(initial_h, 2 * sqrt(mean / k), seed);
+
+    status = symnmf(initial_h, sim, &updated_h);
+    initial_h = NULL;
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* Transfer ownership */
+    *ph = updated_h;
+    updated_h = NULL;
+    if (pnormalized != NULL)
+    {
+        *pnormalized = sim;
+        sim = NULL;
+    }
+
+    status = 0;
+
+lblCleanup:
+    free_matrix(sim);
+    free_matrix(initial_h);
+    free_matrix(updated_h);
+    HEAPFREE(degrees);
+    return status;
+}
+
+int symnmf_fit_batch(PMATRIX* points, int* ks, int jobs, unsigned long seed, int workers, PMATRIX* hs)
+{
+    /* Independent jobs, each one a whole symnmf_fit on a single thread: for many small datasets this keeps all the
+    workers busy, where the parallel kernels of one small job wouldn't. Returns the number of failed jobs (their H stays NULL) */
+    int j = 0;
+    int failed = 0;
+
+    if (workers <= 0)
+        workers = get_thread_count();
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(workers) reduction(+:failed)
+    for (j = 0; j < jobs; j++)
+    {
+        /* The kernels of the job stay on the worker's thread */
+        (void)set_thread_count(1);
+        hs[j] = NULL;
+        if (symnmf_fit(points[j], ks[j], seed, &hs[j], NULL) != 0)
+            failed++;
+    }
+
+    return failed;
+}
+
+int symnmf_fit_restarts(PMATRIX initial, int k, unsigned long* seeds, int restarts, int workers, PMATRIX* ph, int* pbest, PSOLVER_REPORT report)
+{
+    /* symnmf_fit from every seed at once: W is computed once and only read by the restarts, each of them runs on a
+    single worker thread (like the jobs of symnmf_fit_batch), so R restarts on R cores take about the time of one.
+    The H with the lowest final residual is kept. pbest and report may be NULL */
+    int status = -1;
+    int r = 0;
+    int n = 0;
+    int best = 0;
+    int failed = 0;
+    double mean = 0;
+    double* degrees = NULL;
+    PMATRIX sim = NULL;
+    PMATRIX* hs = NULL;
+    PSOLVER_REPORT reports = NULL;
+    W_OPERATOR op;
+
+    n = initial->rows;
+
+    hs = (PMATRIX*)HEAPALLOCZ(hs, (size_t)restarts);
+    reports = (PSOLVER_REPORT)HEAPALLOCZ(reports, (size_t)restarts);
+    if (restarts < 1 || hs == NULL || reports == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    status = sym_ddg(initial, &sim, &degrees);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+    mean = norm_in_place(sim, degrees) / ((double)n * (double)n);
+    (void)dense_operator(sim, &op);
+
+    if (workers <= 0)
+        workers = get_thread_count();
+    if (workers > restarts)
+        workers = restarts;
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(workers) reduction(+:failed)
+    for (r = 0; r < restarts; r++)
+    {
+        PMATRIX initial_h = NULL;
+        SYMNMF_PARAMS params;
+
+        /* The kernels of the restart stay on the worker's thread, H_0 is drawn like in symnmf_fit */
+        (void)set_thread_count(1);
+        (void)default_params(&params);
+        if (create_matrix(n, k, &initial_h) != 0)
+        {
+            failed++;
+            continue;
+        }
+        (void)fill_uniform(initial_h, 2 * sqrt(mean / k), seeds[r]);
+        if (symnmf_solve_with(&op, initial_h, &params, &hs[r], &reports[r]) != 0)
+            failed++;
+    }
+    if (failed > 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* The first of the lowest residuals */
+    for (r = 1; r < restarts; r++)
+        if (reports[r].residual < reports[best].residual)
+            best = r;
+
+    /* Transfer ownership */
+    *ph = hs[best];
+    hs[best] = NULL;
+    if (pbest != NULL)
+        *pbest = best;
+    if (report != NULL)
+        *report = reports[best];
+
+    status = 0;
+
+lblCleanup:
+    if (hs != NULL)
+        for (r = 0; r < restarts; r++)
+            free_matrix(hs[r]);
+    HEAPFREE(hs);
+    HEAPFREE(reports);
+    free_matrix(sim);
+    HEAPFREE(degrees);
+    return status;
+}
+
+int symnmf_fit_operator(PW_OPERATOR normalized, int n, int k, unsigned long seed, PMATRIX* ph)
+{
+    /* The tail of symnmf_fit for a W that is only seen through its products */
+    int status = -1;
+    PMATRIX initial_h = NULL;
+
+    status = initialize_h(normalized, n, k, seed, &initial_h);
     if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        return status;
+    }
+
+    status = symnmf_solve(normalized, initial_h, ph);
+    if (status != 0)
+        printf("An Error Has Occurred\n");
+    return status;
+}
+
+int initialize_h(PW_OPERATOR normalized, int n, int k, unsigned long seed, PMATRIX* pinitial_h)
+{
+    /* The mean of W, for H_0, is the sum of W*1 (one more product) */
+    int status = -1;
+    int i = 0;
+    double mean = 0;
+    PMATRIX ones = NULL;
+    PMATRIX row_sums = NULL;
+    PMATRIX initial_h = NULL;
+
+    if (create_matrix(n, 1, &ones) != 0 ||
+        create_matrix(n, 1, &row_sums) != 0)
     {
         printf("An Error Has Occurred\n");
         status = 1;
         goto lblCleanup;
     }
-    
-    /* Fill the values */
-    for (i = 0; i < n; i++)
+    for (i = 0; i < n; i++)
+        MAT_AT(ones, i, 0) = 1;
+    status = normalized->product(normalized->w, ones, row_sums, NULL);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+    for (i = 0; i < n; i++)
+        mean += MAT_AT(row_sums, i, 0);
+    mean /= (double)n * (double)n;
+
+    /* H_0 ~ U[0, 2 * sqrt(mean(W) / k)) */
+    status = create_matrix(n, k, &initial_h);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+    (void)fill_uniform(initial_h, 2 * sqrt(mean / k), seed);
+
+    /* Transfer ownership */
+    *pinitial_h = initial_h;
+    initial_h = NULL;
+
+    status = 0;
+
+lblCleanup:
+    free_matrix(ones);
+    free_matrix(row_sums);
+    free_matrix(initial_h);
+    return status;
+}
+
+int symnmf_sparse(PMATRIX initial_h, PCSR_MATRIX normalized, PMATRIX* pupdated_h)
+{
+    W_OPERATOR op;
+
+    (void)sparse_operator(normalized, &op);
+    return symnmf_solve(&op, initial_h, pupdated_h);
+}
+
+int symnmf_solve(PW_OPERATOR normalized, PMATRIX initial_h, PMATRIX* pupdated_h)
+{
+    SYMNMF_PARAMS params;
+
+    (void)default_params(&params);
+    return symnmf_solve_with(normalized, initial_h, &params, pupdated_h, NULL);
+}
+
+int symnmf_solve_with(PW_OPERATOR normalized, PMATRIX initial_h, PSYMNMF_PARAMS params, PMATRIX* pupdated_h, PSOLVER_REPORT report)
+{
+    static const SOLVER_STEP steps[SOLVER_COUNT] = { perform_iteration, momentum_iteration, hals_iteration, anls_iteration };
+    int status = -1;
+    int i = 0;
+    int convergence = 0; /* initialized to False */
+    double delta = 0;
+    double last_residual = HUGE_VAL; /* the residual at the last check */
+    double start = 0;
+    PSYMNMF_CONTEXT context = NULL;
+
+    if (validate_params(params) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        free_matrix(initial_h);
+        status = 1;
+        goto lblCleanup;
+    }
+    start = get_wall_time();
+
+    /* All the workspaces are allocated once, the context takes ownership of initial_h */
+    status = create_symnmf_context(normalized, initial_h, params, &context);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* The residuals are only compared with each other, unless their value is asked for */
+    if ((params->target_residual > 0 || params->criterion == STOP_ON_OBJECTIVE || report != NULL) &&
+        normalized->squared_norm(normalized->w, &context->squared_norm) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+
+    /* update H until convergence */
+    i = 0;
+    while (!convergence && i < params->max_iter)
+    {
+        /* perform an update, which also measures how much H changed and the residual */
+        status = steps[params->solver](context, &delta);
+        if (status != 0)
+        {
+            printf("An Error Has Occurred\n");
+            goto lblCleanup;
+        }
+        i++;
+
+        /* check convergence, every check_interval iterations */
+        if (i % params->check_interval != 0)
+            continue;
+        if (params->target_residual > 0 && context->residual <= params->target_residual)
+            convergence = 1; /* True */
+        else if (params->criterion == STOP_ON_DELTA)
+            convergence = (delta < params->epsilon);
+        else
+            convergence = (last_residual < HUGE_VAL && fabs(last_residual - context->residual) <= params->epsilon * last_residual);
+        last_residual = context->residual;
+    }
+
+    if (report != NULL)
     {
-        for (j = 0; j < n; j++)
+        report->iterations = i;
+        report->converged = convergence;
+        report->seconds = get_wall_time() - start;
+
+        /* The residual seen last belongs to the H of the last product, not to the final H */
+        status = measure_residual(context);
+        if (status != 0)
         {
-            if (i == j)
-                sim->coords[i][j] = 0;
-            else
-                sim->coords[i][j] = find_exp(initial->coords[i], initial->coords[j], d); 
+            printf("An Error Has Occurred\n");
+            goto lblCleanup;
         }
+        report->residual = context->residual;
     }
 
     /* Transfer ownership */
-    *psim = sim;
-    sim = NULL;
+    *pupdated_h = detach_current_h(context);
 
     status = 0;
 
 lblCleanup:
-    free_matrix(sim);
+    free_symnmf_context(context);
     return status;
 }
 
-int ddg(PMATRIX sim, PMATRIX* pdiagonal)/* A -> D */
+void default_params(PSYMNMF_PARAMS params)
 {
-    int status = -1;
-    int i, j = 0;
-    int n = 0;
-    double sum = 0;
-    PMATRIX diagonal = NULL;
+    params->solver = SOLVER_MU;
+    params->beta = DEFAULT_BETA;
+    params->epsilon = DEFAULT_EPSILON;
+    params->max_iter = DEFAULT_MAX_ITER;
+    params->criterion = STOP_ON_DELTA;
+    params->check_interval = 1;
+    params->target_residual = 0;
+    params->split_penalty = DEFAULT_SPLIT_PENALTY;
+    params->inner_steps = DEFAULT_ANLS_INNER_STEPS;
+}
 
-    n = sim->rows;
+int validate_params(PSYMNMF_PARAMS params)
+{
+    if ((int)params->solver < 0 || params->solver >= SOLVER_COUNT ||
+        (int)params->criterion < 0 || params->criterion >= STOP_COUNT ||
+        !(params->beta > 0 && params->beta <= 1) || !(params->epsilon >= 0) || params->max_iter < 0 ||
+        params->check_interval < 1 || !(params->split_penalty > 0) || params->inner_steps < 1)
+        return 1;
+    return 0;
+}
 
-    /* Allocate a zero-ed matrix nXn */
-    status = create_matrix(n, n, &diagonal); 
-    if (status != 0)
-    {
-        printf("An Error Has Occurred\n");
-        status = 1;
-        goto lblCleanup;
-    }
-    
-    /* Fill the values of diagonal by going over rows of sim */
-    for (i = 0; i < n; i++)
+static int dense_product(void* w, PMATRIX H, PMATRIX WH, PGEMM_WORKSPACE workspace)
+{
+    return gemm((PMATRIX)w, H, WH, workspace);
+}
+
+static int dense_squared_norm(void* w, double* pnorm)
+{
+    int i, j = 0;
+    double total = 0;
+    REAL* row = NULL;
+    PMATRIX normalized = (PMATRIX)w;
+
+#pragma omp parallel for schedule(static) private(j, row) reduction(+:total)
+    for (i = 0; i < normalized->rows; i++)
     {
-        for (j = 0; j < n; j++)
-        {
-            sum += sim->coords[i][j];
-        }
-        diagonal->coords[i][i] = sum; 
-        sum = 0; /* resetting sum for next iteration */  
+        row = MAT_ROW(normalized, i);
+        for (j = 0; j < normalized->cols; j++)
+            total += (double)row[j] * row[j];
     }
 
-    /* Transfer ownership */
-    *pdiagonal = diagonal;
-    diagonal = NULL;
-
-    status = 0;
+    *pnorm = total;
+    return 0;
+}
 
-lblCleanup:
-    free_matrix(diagonal);
-    return status;
+void dense_operator(PMATRIX normalized, PW_OPERATOR op)
+{
+    op->w = normalized;
+    op->product = dense_product;
+    op->squared_norm = dense_squared_norm;
 }
 
-int norm(PMATRIX sim, PMATRIX diagonal, PMATRIX* pnormalized)
+int create_symnmf_context(PW_OPERATOR normalized, PMATRIX initial_h, PSYMNMF_PARAMS params, PSYMNMF_CONTEXT* pcontext)
 {
     int status = -1;
-    PMATRIX temp = NULL; /* Will store result of D^(-1/2) * A */
-    PMATRIX res = NULL; /* Will store end result */
+    int n, k = 0;
+    PSYMNMF_CONTEXT context = NULL;
 
-     /* Computing D^(-0.5) */
-    (void)pow_diag(diagonal, -0.5); 
+    n = initial_h->rows;
+    k = initial_h->cols;
 
-    /* Computing D^(-0.5)*A and storing it in temp */
-    status = mat_mult(diagonal, sim, &temp);
-    if (status != 0)
+    context = (PSYMNMF_CONTEXT)HEAPALLOCZ(context, 1);
+    if (context == NULL)
     {
         printf("An Error Has Occurred\n");
+        free_matrix(initial_h);
         status = 1;
         goto lblCleanup;
     }
 
-    /* Computing W */
-    status = mat_mult(temp, diagonal, &res);
-    if (status != 0)
+    /* From now on initial_h is freed together with the context */
+    context->normalized = *normalized;
+    context->params = *params;
+    context->h[0] = initial_h;
+    context->current = 0;
+    context->momentum = 1;
+    context->residual = HUGE_VAL;
+
+    if (create_matrix(n, k, &context->h[1]) != 0 ||
+        create_matrix(n, k, &context->numerator) != 0 ||
+        create_matrix(k, k, &context->gram) != 0 ||
+        create_matrix(n, k, &context->denominator) != 0 ||
+        create_gemm_workspace(&context->gemm_workspace) != 0)
     {
         printf("An Error Has Occurred\n");
         status = 1;
         goto lblCleanup;
     }
 
+    /* The solvers on the split H, G start from G = H_0 */
+    if (params->solver != SOLVER_MU)
+    {
+        status = create_matrix(n, k, &context->auxiliary);
+        if (status != 0)
+        {
+            printf("An Error Has Occurred\n");
+            status = 1;
+            goto lblCleanup;
+        }
+        if (params->solver == SOLVER_HALS || params->solver == SOLVER_ANLS)
+            (void)memcpy(context->auxiliary->data, initial_h->data, (size_t)n * (size_t)initial_h->stride * sizeof(REAL));
+    }
+
     /* Transfer ownership */
-    *pnormalized = res;
-    res = NULL;
+    *pcontext = context;
+    context = NULL;
 
     status = 0;
 
 lblCleanup:
-    free_matrix(temp);
-    free_matrix(res);
+    free_symnmf_context(context);
     return status;
 }
 
-int symnmf(PMATRIX initial_h, PMATRIX normalized, PMATRIX* pupdated_h)
+void free_symnmf_context(PSYMNMF_CONTEXT context)
 {
-    int status = -1;
-    int i = 0;
-    int convergence = 0; /* initialized to False */
-    double delta = 0;
-    PMATRIX prev_h = NULL; 
-    PMATRIX updated_h = NULL; 
-
-    /* update H until convergence */
-    prev_h = initial_h;
-    initial_h = NULL; /* will be freed by freeing prev_h in the first iteration */
-    i = 0;
-    
-    while (!convergence && i < MAX_ITER)
+    if (context != NULL)
     {
-        /* perform an update */
-        status = perform_iteration(prev_h, normalized, &updated_h, BETA);
-        if (status == 1)
-        {
-            printf("An Error Has Occurred\n");
-            goto lblCleanup;
-        }
+        free_matrix(context->h[0]);
+        free_matrix(context->h[1]);
+        free_matrix(context->numerator);
+        free_matrix(context->gram);
+        free_matrix(context->denominator);
+        free_matrix(context->auxiliary);
+        free_gemm_workspace(context->gemm_workspace);
+        HEAPFREE(context);
+    }
+}
 
-        /* check convergence */
-        status = squared_frob_norm(updated_h, prev_h, &delta);
-        if (status == 1)
-        {
-            printf("An Error Has Occurred\n");
-            goto lblCleanup;
-        }
+PMATRIX detach_current_h(PSYMNMF_CONTEXT context)
+{
+    PMATRIX current_h = context->h[context->current];
+    context->h[context->current] = NULL;
+    return current_h;
+}
 
-        if (delta < EPSILON)
-            convergence = 1; /* True */
+void set_thread_count(int threads)
+{
+#ifdef _OPENMP
+    /* 0 (or less) means one thread per core */
+    omp_set_num_threads((threads > 0) ? threads : omp_get_num_procs());
+#else
+    (void)threads;
+#endif
+}
 
-        /* free our current prev - and update it to be the current result (updated_h) */
-        free_matrix(prev_h);
-        prev_h = updated_h;
-        i++;
-    }
+int get_thread_count(void)
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
 
-    /* Transfer ownership */
-    *pupdated_h = updated_h;
-    updated_h = NULL;
+int get_thread_index(void)
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
 
-    status = 0;
+double get_wall_time(void)
+{
+    struct timespec now;
 
-lblCleanup:
-    free_matrix(updated_h);
-    return status;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + 1e-9 * (double)now.tv_nsec;
+}
+
+void* heap_alloc_aligned(size_t size)
+{
+    void* buffer = NULL;
+
+    /* a zero-sized request may legally return NULL, which we reserve for failures */
+    if (size == 0)
+        size = MATRIX_ALIGNMENT;
+
+    if (posix_memalign(&buffer, MATRIX_ALIGNMENT, size) != 0)
+        return NULL;
+
+    (void)memset(buffer, 0, size);
+    return buffer;
 }
 
 int create_matrix(int rows, int cols, PMATRIX* pmatrix)
 {
     int status = -1;
-    double** coords = NULL;
-    PMATRIX matrix = NULL;
     int i = 0;
+    int stride = 0;
+    size_t size = 0;
+    void* data = NULL;
+    PMATRIX matrix = NULL;
 
     /* allocate the matrix */
     matrix = (PMATRIX)HEAPALLOCZ(matrix, 1);
@@ -336,29 +857,28 @@ int create_matrix(int rows, int cols, PMATRIX* pmatrix)
         goto lblCleanup;
     }
 
-    /* allocate the coords */
-    coords = (double**)HEAPALLOCZ(coords, rows);
-    if (coords == NULL)
+    /* pad every row of a cache line or more to a whole number of aligned blocks, so each row starts aligned as well */
+    stride = MATRIX_STRIDE(cols);
+
+    /* allocate all the coords as one contiguous buffer */
+    size = (size_t)rows * (size_t)stride * sizeof(REAL);
+    if (posix_memalign(&data, MATRIX_ALIGNMENT, (size > 0) ? size : MATRIX_ALIGNMENT) != 0)
     {
         printf("An Error Has Occurred\n");
         status = 1;
         goto lblCleanup;
     }
-    
+
+    /* Zero the rows with the same static row partition the kernels use, so on a NUMA machine
+    each page is first touched (and so placed) by the thread that later works on it */
+#pragma omp parallel for schedule(static)
     for (i = 0; i < rows; i++)
-    {
-        coords[i] = (double*)HEAPALLOCZ(coords[i], cols);
-        if (coords[i] == NULL)
-        {
-            printf("An Error Has Occurred\n");
-            status = 1;
-            goto lblCleanup;
-        }
-    }
+        (void)memset((REAL*)data + (size_t)i * (size_t)stride, 0, (size_t)stride * sizeof(REAL));
     
-    matrix->coords = coords;
+    matrix->data = (REAL*)data;
     matrix->rows = rows;
     matrix->cols = cols;
+    matrix->stride = stride;
 
     /* Transfer ownership */
     *pmatrix = matrix;
@@ -389,7 +909,7 @@ int transpose_matrix(PMATRIX matrix, PMATRIX* ptransposed)
     /* Fill the values */
     for (i = 0; i < transposed->rows; i++)
         for (j = 0; j < transposed->cols; j++)
-            transposed->coords[i][j] = matrix->coords[j][i];
+            MAT_AT(transposed, i, j) = MAT_AT(matrix, j, i);
 
     /* Transfer ownership */
     *ptransposed = transposed;
@@ -402,18 +922,32 @@ lblCleanup:
     return status;
 }
 
+void scale_rows(PMATRIX source, double* scale, PMATRIX target)
+{
+    /* target = diag(scale) * source, target may be source */
+    int i, j = 0;
+    REAL* source_row = NULL;
+    REAL* target_row = NULL;
+
+#pragma omp parallel for schedule(static) private(j, source_row, target_row)
+    for (i = 0; i < source->rows; i++)
+    {
+        source_row = MAT_ROW(source, i);
+        target_row = MAT_ROW(target, i);
+        for (j = 0; j < source->cols; j++)
+            target_row[j] = (REAL)(source_row[j] * scale[i]);
+    }
+}
+
 void free_matrix(PMATRIX matrix)
 {
-    int i = 0;
     if (matrix != NULL)
     {
-        /* free all the one-dimensional arrays */
-        if (matrix->coords != NULL)
-            for (i = 0; i < matrix->rows; i++)
-                HEAPFREE(matrix->coords[i]);
-
-        /* free the two-dimensional pointer */
-        HEAPFREE(matrix->coords);
+        /* free the contiguous buffer (or the file mapping it lives in), and then the matrix itself */
+        if (matrix->mapping != NULL)
+            (void)unmap_matrix(matrix);
+        if (!matrix->borrowed)
+            HEAPFREE(matrix->data);
         HEAPFREE(matrix);
     }
 }
@@ -421,210 +955,163 @@ void free_matrix(PMATRIX matrix)
 void print_matrix(PMATRIX matrix)
 {
     int i, j = 0;
+    REAL* row = NULL;
     for (i = 0; i < matrix->rows; i++)
     {
+        row = MAT_ROW(matrix, i);
         for (j = 0; j < matrix->cols - 1; j++)
-            printf("%.4f,", matrix->coords[i][j]);
-        printf("%.4f\n", matrix->coords[i][j]);
+            printf("%.4f,", row[j]);
+        printf("%.4f\n", row[j]);
     }
 }
 
-int parse_file(char* file_name, int* n, int* d)
+int diagonal_from_degrees(double* degrees, int n, PMATRIX* pdiagonal)
 {
     int status = -1;
-    int rows = 0;
-    int cols = 0;
-    FILE* fp = NULL;
-    char* line = NULL;
-    char* token = NULL;
-    size_t len = 0;
-    ssize_t read = 0;
+    int i = 0;
+    PMATRIX diagonal = NULL;
 
-    fp = fopen(file_name, "r");
-    if (fp == NULL) 
+    /* Allocate a zero-ed matrix nXn */
+    status = create_matrix(n, n, &diagonal); 
+    if (status != 0)
     {
         printf("An Error Has Occurred\n");
         status = 1;
         goto lblCleanup;
     }
 
-    while ((read = getline(&line, &len, fp)) != -1) 
-    {
-        /* Increase the number of rows */
-        rows++;
-
-        if (rows > 1)
-            continue;
-        
-        /* Calculate the number of columns - only first row */ 
-        token = strtok(line, ",");
-        while (token != NULL) {
-            token = strtok(NULL, ",");
-            cols++;
-        }
-    }
+    for (i = 0; i < n; i++)
+        MAT_AT(diagonal, i, i) = (REAL)degrees[i];
 
-    /* Transfer results */
-    *n = rows;
-    *d = cols;
+    /* Transfer ownership */
+    *pdiagonal = diagonal;
+    diagonal = NULL;
 
     status = 0;
 
 lblCleanup:
-    HEAPFREE(line);
-    fclose(fp);
+    free_matrix(diagonal);
     return status;
 }
 
-int read_initial_from_file(char* file_name, PMATRIX matrix)
+int perform_iteration(PSYMNMF_CONTEXT context, double* pdelta)
 {
-    int status = -1;
-    FILE* fp = NULL;
-    char* line = NULL;
-    char* token = NULL;
-    size_t len = 0;
-    ssize_t read = 0;
     int i, j = 0;
-    double value = 0;
+    int n, k = 0;
+    double beta = context->params.beta;
+    double delta = 0;
+    double trace = 0;
+    double diff = 0;
+    REAL* new_row = NULL;
+    REAL* prev_row = NULL;
+    REAL* numerator_row = NULL;
+    REAL* denominator_row = NULL;
+    PMATRIX prev = context->h[context->current];
+    PMATRIX new = context->h[1 - context->current]; /* H(i-1), overwritten by H(i+1) */
+    PMATRIX numerator_mat = context->numerator; /* This is WH */
+    PMATRIX temp = context->gram; /* This is H^T * H */
+    PMATRIX denominator_mat = context->denominator; /* This is H*H^T*H*/
 
-    fp = fopen(file_name, "r");
-    if (fp == NULL) 
-    {
-        printf("An Error Has Occurred\n");
-        status = 1;
-        goto lblCleanup;
-    }
+    n = prev->rows; /* Note that the dimensions of prev and new are the same */
+    k = prev->cols;
 
-    /* Fill the matrix with the data from the file */
-    for (i = 0; i < matrix->rows; i++)
+    /* Computing numerator matrix */
+    if (context->normalized.product(context->normalized.w, prev, numerator_mat, context->gemm_workspace) != 0)
+        return 1;
+
+    /* Computing temp - the kXk gram matrix, straight from the rows of H */
+    if (gram(prev, temp) != 0)
+        return 1;
+    
+    /* Computing denominator matrix as H*(H^T*H), a skinny nXkXk product */
+    (void)mult_small(prev, temp, denominator_mat);
+
+    /* Fill the values, and measure ||H(i+1) - H(i)||^2 and tr(H(i)^T*W*H(i)) (for the residual) on the way */
+#pragma omp parallel for schedule(static) private(j, diff, new_row, prev_row, numerator_row, denominator_row) reduction(+:delta, trace)
+    for (i = 0; i < n; i++)
     {
-        read = getline(&line, &len, fp);
-        if (read == -1)
-        {
-            printf("An Error Has Occurred\n");
-            status = 1;
-            goto lblCleanup;
-        }
-        
-        token = strtok(line, ",");
-        for (j = 0; j < matrix->cols; j++)
+        new_row = MAT_ROW(new, i);
+        prev_row = MAT_ROW(prev, i);
+        numerator_row = MAT_ROW(numerator_mat, i);
+        denominator_row = MAT_ROW(denominator_mat, i);
+        for (j = 0; j < k; j++)
         {
-            value = atof(token);
-            matrix->coords[i][j] = value;
-            token = strtok(NULL, ",");
+            new_row[j] = (REAL)calculate_cell(numerator_row[j], denominator_row[j], prev_row[j], beta);
+            diff = new_row[j] - prev_row[j];
+            delta += diff * diff;
+            trace += (double)prev_row[j] * numerator_row[j];
         }
     }
+    context->residual = residual_from_trace(context, trace);
 
-    status = 0;
+    /* The new H becomes the current one */
+    context->current = 1 - context->current;
+    *pdelta = delta;
 
-lblCleanup:
-    HEAPFREE(line);
-    fclose(fp);
-    return status;
+    return 0;
 }
 
-int perform_iteration(PMATRIX prev, PMATRIX normalized, PMATRIX* pnew, double beta)
+
+double residual_from_trace(PSYMNMF_CONTEXT context, double trace)
 {
-    int status = -1;
+    /* ||W - H*H^T||^2 = ||W||^2 - 2*tr(H^T*W*H) + ||H^T*H||^2, without the nXn H*H^T:
+    tr(H^T*W*H) is the sum of H o (W*H), which the updates sum while they read both, and H^T*H is at hand */
     int i, j = 0;
-    int n, k = 0;
-    PMATRIX new = NULL;
-    PMATRIX numerator_mat = NULL; /* This is WH */
-    PMATRIX temp = NULL; /* This is H^T * H */
-    PMATRIX denominator_mat = NULL; /* This is H*H^T*H*/
-    PMATRIX prev_transposed = NULL; /* This is H^T */
-
-    n = prev->rows; /* Note that the dimensions of prev and new are the same */
-    k = prev->cols;
+    double gram_norm = 0;
+    int k = context->gram->cols;
 
-    /* Allocate a zero-ed matrix nXk */
-    status = create_matrix(n, k, &new);
-    if (status != 0)
-    {
-        printf("An Error Has Occurred\n");
-        status = 1;
-        goto lblCleanup;
-    }
+    for (i = 0; i < k; i++)
+        for (j = 0; j < k; j++)
+            gram_norm += (double)MAT_AT(context->gram, i, j) * MAT_AT(context->gram, i, j);
 
-    /* Computing numerator matrix */
-    status = mat_mult(normalized, prev, &numerator_mat);
-    if (status != 0)
-    {
-        printf("An Error Has Occurred\n");
-        status = 1;
-        goto lblCleanup;
-    }
+    return context->squared_norm - 2 * trace + gram_norm;
+}
 
-    /* Create prev transposed */
-    status = transpose_matrix(prev, &prev_transposed);
-    if (status != 0)
-    {
-        printf("An Error Has Occurred\n");
-        status = 1;
-        goto lblCleanup;
-    }
+double residual_from_products(PSYMNMF_CONTEXT context, PMATRIX H)
+{
+    int i, j = 0;
+    double trace = 0;
+    REAL* h_row = NULL;
+    REAL* wh_row = NULL;
 
-    /* Computing temp */
-    status = mat_mult(prev_transposed, prev, &temp);
-    if (status != 0)
-    {
-        printf("An Error Has Occurred\n");
-        status = 1;
-        goto lblCleanup;
-    }
-    
-    /* Computing denominator matrix */
-    status = mat_mult(prev, temp, &denominator_mat);
-    if (status != 0)
+#pragma omp parallel for schedule(static) private(j, h_row, wh_row) reduction(+:trace)
+    for (i = 0; i < H->rows; i++)
     {
-        printf("An Error Has Occurred\n");
-        status = 1;
-        goto lblCleanup;
+        h_row = MAT_ROW(H, i);
+        wh_row = MAT_ROW(context->numerator, i);
+        for (j = 0; j < H->cols; j++)
+            trace += (double)h_row[j] * wh_row[j];
     }
 
-    /* Fill the values */
-    for (i = 0; i < n; i++)
-    {
-        for (j = 0; j < k; j++)
-        {
-            new->coords[i][j] = calculate_cell(
-                numerator_mat->coords[i][j], 
-                denominator_mat->coords[i][j], 
-                prev->coords[i][j], 
-                beta);
-        }
-    }
+    return residual_from_trace(context, trace);
+}
 
-    /* Transfer ownership */
-    *pnew = new;
-    new = NULL;
+int measure_residual(PSYMNMF_CONTEXT context)
+{
+    PMATRIX current = context->h[context->current];
 
-    status = 0;
+    if (context->normalized.product(context->normalized.w, current, context->numerator, context->gemm_workspace) != 0 ||
+        gram(current, context->gram) != 0)
+        return 1;
 
-lblCleanup:
-    free_matrix(new);
-    free_matrix(numerator_mat);
-    free_matrix(prev_transposed);
-    free_matrix(temp);
-    free_matrix(denominator_mat);
-    return status;
+    context->residual = residual_from_products(context, current);
+    return 0;
 }
 
-
 int main(int argc, char *argv[])
 {
     int status = -1;
     char* goal = NULL;
     char* file_name = NULL;
-    int n, d = 0;
+    int n = 0;
+    double* degrees = NULL;
     PMATRIX initial = NULL;
     PMATRIX sim = NULL;
     PMATRIX diagonal = NULL;
-    PMATRIX normalized = NULL;
     PMATRIX result = NULL;
     
     /* Validate arguments */
-    if (argc < ARGS_COUNT || argc > ARGS_COUNT)
+    if (argc < ARGS_REQUIRED || argc > ARGS_COUNT)
     {
         printf("An Error Has Occurred\n");
         status = 1;
@@ -633,36 +1120,44 @@ int main(int argc, char *argv[])
 
     goal = argv[ARGS_GOAL];
     file_name = argv[ARGS_FILE_NAME];
+    (void)init_sim_kernel();
 
-    /* Deduce n and d, by reading the file */
-    status = parse_file(file_name, &n, &d);
-    if (status != 0)
+    /* The number of threads is optional, by default one per core (or OMP_NUM_THREADS) */
+    if (argc > ARGS_THREADS && strcmp(goal, "convert") != 0)
+        (void)set_thread_count(atoi(argv[ARGS_THREADS]));
+
+    /* The benchmark of the stages on synthetic points, e.g. ./symnmf bench bench.json - the file is its output */
+    if (strcmp(goal, "bench") == 0)
     {
-        printf("An Error Has Occurred\n");
-        status = 1;
+        status = run_benchmark(file_name);
         goto lblCleanup;
     }
-    
-    /* Allocate a zero-ed matrix nXd */
-    status = create_matrix(n, d, &initial);
+
+    /* Read the initial matrix from the file, a binary matrix file is mapped instead of parsed */
+    status = load_matrix(file_name, &initial);
     if (status != 0)
     {
         printf("An Error Has Occurred\n");
         status = 1;
         goto lblCleanup;
     }
+    n = initial->rows;
 
-    /* Read the initial matrix from the file */
-    status = read_initial_from_file(file_name, initial);
-    if (status != 0)
+    /* Conversion to a binary matrix file, e.g. ./symnmf convert input.txt input.mat */
+    if (strcmp(goal, "convert") == 0)
     {
-        printf("An Error Has Occurred\n");
-        status = 1;
+        if (argc <= ARGS_OUTPUT_FILE_NAME || save_matrix_file(argv[ARGS_OUTPUT_FILE_NAME], initial) != 0)
+        {
+            printf("An Error Has Occurred\n");
+            status = 1;
+        }
+        else
+            status = 0;
         goto lblCleanup;
     }
 
-    /* Perform logic according to goal */
-    status = sym(initial, &sim);
+    /* Perform logic according to goal - the degrees come for free with the similarity matrix */
+    status = sym_ddg(initial, &sim, &degrees);
     if (status == 1)
     {
         printf("An Error Has Occurred\n");
@@ -671,27 +1166,22 @@ int main(int argc, char *argv[])
     
     if (strcmp(goal, "sym") == 0)
         result = sim;
-    else
+    else if (strcmp(goal, "ddg") == 0)
     {
-        status = ddg(sim, &diagonal);
+        /* Only the ddg goal needs the dense D */
+        status = diagonal_from_degrees(degrees, n, &diagonal);
         if (status == 1)
         {
             printf("An Error Has Occurred\n");
             goto lblCleanup;
         }
-        if (strcmp(goal, "ddg") == 0)
-            result = diagonal;
-        else
-        {
-            status = norm(sim, diagonal, &normalized);
-            if (status == 1)
-            {
-                printf("An Error Has Occurred\n");
-                goto lblCleanup;
-            }
-            if (strcmp(goal, "norm") == 0)
-                result = normalized;
-        }
+        result = diagonal;
+    }
+    else if (strcmp(goal, "norm") == 0)
+    {
+        /* A becomes W in place */
+        (void)norm_in_place(sim, degrees);
+        result = sim;
     }
 
     /* Goal wasn't one of the following: {sym, ddg, norm} */
@@ -707,7 +1197,7 @@ int main(int argc, char *argv[])
 lblCleanup:
     free_matrix(initial);
     free_matrix(sim);
+    HEAPFREE(degrees);
     free_matrix(diagonal);
-    free_matrix(normalized);
     return status;
 }
@@ -7,15 +7,43 @@ are used in symnmfmodule.c and implemented at symnmf.c */
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 /* MACROS */
-#define BETA (0.5)
-#define EPSILON (0.0001)
-#define MAX_ITER (300)
+/* Defaults of SYMNMF_PARAMS (see default_params), every solve can override them */
+#define DEFAULT_BETA (0.5)
+#define DEFAULT_EPSILON (0.0001)
+#define DEFAULT_MAX_ITER (300)
+#define DEFAULT_SPLIT_PENALTY (1.0) /* alpha of the HALS and ANLS solvers: above half the spectral norm of W (at most 1 once normalized), H and G meet */
+#define DEFAULT_ANLS_INNER_STEPS (10) /* projected gradient steps per half iteration of the ANLS solver */
+/* The K-means of the analysis (kmeans.c): it stops once no centroid moved by KMEANS_EPSILON, or after KMEANS_MAX_ITER */
+#define KMEANS_EPSILON (0.0001)
+#define KMEANS_MAX_ITER (300)
+
+/* ELEMENT TYPE of the matrices, chosen at build time (make PRECISION=-DSYMNMF_FLOAT32 for single precision).
+Reductions (degrees, norms, dot products, sums and deltas) always accumulate in double */
+#ifdef SYMNMF_FLOAT32
+typedef float REAL;
+#define REAL_FORMAT "f" /* buffer protocol format */
+#else
+typedef double REAL;
+#define REAL_FORMAT "d"
+#endif
 
 /* Allocates a zero-ed buffer of n elements from pointer p on the heap, casts the return value to the pointer's type */
 #define HEAPALLOCZ(p, n) calloc((n), sizeof(*p))
 
+/* Matrices are allocated aligned to a cache line (which is also the width of an AVX-512 register) */
+#define MATRIX_ALIGNMENT (64)
+#define MATRIX_ALIGN_ELEMENTS (MATRIX_ALIGNMENT / sizeof(REAL))
+/* The row stride of create_matrix: a row of at least a cache line is padded to whole cache lines, so every row starts
+aligned; a narrower row (the points, H) is packed, padding it would multiply its size for no kernel's sake */
+#define MATRIX_STRIDE(cols) (((cols) < (int)MATRIX_ALIGN_ELEMENTS) ? (cols) : \
+    (int)((((cols) + MATRIX_ALIGN_ELEMENTS - 1) / MATRIX_ALIGN_ELEMENTS) * MATRIX_ALIGN_ELEMENTS))
+
 /* Safely frees a buffer allocated on the heap */
 #define HEAPFREE(p)					\
 {									\
@@ -26,45 +54,408 @@ are used in symnmfmodule.c and implemented at symnmf.c */
 	}								\
 }
 
+/* GEMM TUNING: cache-blocking and register-tile sizes of the matrix multiplication engine.
+Chosen at build time, e.g. make GEMM_TILES="-DGEMM_KC=128 -DGEMM_MC=72" */
+#ifndef GEMM_MR
+#define GEMM_MR (4) /* rows of the register tile computed by the micro-kernel */
+#endif
+#ifndef GEMM_NR
+#define GEMM_NR (8) /* columns of the register tile computed by the micro-kernel */
+#endif
+#ifndef GEMM_KC
+#define GEMM_KC (256) /* depth of a packed panel: an MR x KC panel of A and a KC x NR panel of B fit in L1 */
+#endif
+#ifndef GEMM_MC
+#define GEMM_MC (128) /* rows of A packed per block: an MC x KC block of A fits in L2, multiple of GEMM_MR */
+#endif
+#ifndef GEMM_NC
+#define GEMM_NC (4096) /* columns of B packed per block: a KC x NC block of B fits in L3, multiple of GEMM_NR */
+#endif
+
+/* OUT-OF-CORE TUNING: bytes of A resident per tile when W lives in a scratch file (see outofcore.c),
+a tile has at least GEMM_MC rows per thread. e.g. make GEMM_TILES="-DW_TILE_BYTES=268435456" */
+#ifndef W_TILE_BYTES
+#define W_TILE_BYTES ((size_t)1 << 30)
+#endif
+
 /* TYPEDEFS */
 typedef struct _MATRIX
 {
-    double** coords;
+    REAL* data; /* all the coords, as one contiguous row-major buffer aligned to MATRIX_ALIGNMENT */
 	int rows;
 	int cols;
+	int stride; /* distance (in elements) between the starts of two consecutive rows, cols <= stride */
+    void* mapping; /* the file mapping data lives in (see matio.c), NULL if data is on the heap */
+    int borrowed; /* data belongs to someone else (e.g. a python buffer), free_matrix leaves it */
+    size_t mapping_length;
 } MATRIX;
 typedef MATRIX* PMATRIX;
 
+/* Returns a pointer to the i-th row of matrix m */
+#define MAT_ROW(m, i) ((m)->data + (size_t)(i) * (size_t)(m)->stride)
+
+/* Accesses the coord at row i and column j of matrix m */
+#define MAT_AT(m, i, j) (MAT_ROW((m), (i))[(j)])
+
+typedef struct _GEMM_WORKSPACE
+{
+    int threads; /* number of threads the workspace was sized for */
+    REAL* packed_a; /* a GEMM_MC x GEMM_KC block of A per thread, packed as MR-row panels */
+    REAL* packed_b; /* a GEMM_KC x GEMM_NC block of B, packed as NR-column panels */
+} GEMM_WORKSPACE;
+typedef GEMM_WORKSPACE* PGEMM_WORKSPACE;
+
+/* Fills out[j0:j1] with the similarities of point x_i to the points j0..j1-1, see simd.c */
+typedef void (*SIM_ROW_KERNEL)(const REAL* xi, double norm_i, PMATRIX points_t, const double* norms, int j0, int j1, REAL* out);
+
+typedef struct _CSR_MATRIX
+{
+    int rows;
+    int cols;
+    size_t nnz; /* number of stored entries */
+    size_t* row_ptr; /* rows+1 offsets: the entries of row i are [row_ptr[i], row_ptr[i+1]) */
+    int* col_idx; /* column of every entry, ascending within a row */
+    REAL* values; /* value of every entry */
+} CSR_MATRIX;
+typedef CSR_MATRIX* PCSR_MATRIX;
+
+/* WH = W*H, for whatever representation w of W */
+typedef int (*W_PRODUCT)(void* w, PMATRIX H, PMATRIX WH, PGEMM_WORKSPACE workspace);
+
+/* ||W||_F^2, for whatever representation w of W */
+typedef int (*W_SQUARED_NORM)(void* w, double* pnorm);
+
+/* W, as far as the solver is concerned: anything that multiplies an nXk H */
+typedef struct _W_OPERATOR
+{
+    void* w; /* not owned */
+    W_PRODUCT product;
+    W_SQUARED_NORM squared_norm; /* for the residual, asked for once per solve */
+} W_OPERATOR;
+typedef W_OPERATOR* PW_OPERATOR;
+
+/* W = D^(-0.5)*A*D^(-0.5) kept out of core: A lives in a scratch file and is streamed in row tiles */
+typedef struct _W_TILES
+{
+    PMATRIX sim; /* A: nXn, a shared mapping of an unlinked scratch file */
+    double* scale; /* the diagonal of D^(-0.5) */
+    int tile_rows; /* rows of A per tile */
+    PMATRIX scaled_h; /* D^(-0.5)*H: scratch of the product, nXk */
+} W_TILES;
+typedef W_TILES* PW_TILES;
+
+/* W ~ D^(-0.5)*A*D^(-0.5) from m landmarks: A ~ F*F^T with its diagonal taken out, F = C*M^(-0.5)
+for the nXm similarities C to the landmarks and the mXm similarities M between them (Nystrom) */
+typedef struct _W_NYSTROM
+{
+    PMATRIX factor; /* F: nXr, r <= m the rank kept by the pseudo-inverse of M */
+    double* diagonal; /* the diagonal of F*F^T */
+    double* scale; /* the diagonal of D^(-0.5) */
+    PMATRIX scaled_h; /* D^(-0.5)*H: scratch of the product, nXk */
+    PMATRIX projected; /* F^T*D^(-0.5)*H: scratch of the product, rXk */
+} W_NYSTROM;
+typedef W_NYSTROM* PW_NYSTROM;
+
+/* The state of an incremental fit, points arrive in batches (see stream.c). The buffers are allocated with room
+to grow, so appending m points touches O(m*n) entries of A, and W = D^(-0.5)*A*D^(-0.5) is never formed */
+typedef struct _SYMNMF_STREAM
+{
+    int n; /* points appended so far */
+    int capacity; /* rows allocated in points and sim (and columns in sim) */
+    int d;
+    int k;
+    unsigned long seed;
+    PMATRIX points; /* X: capacityXd, the first n rows are used, NULL before the first append */
+    PMATRIX sim; /* A: capacityXcapacity, the leading nXn block is used */
+    double* degrees; /* the diagonal of D */
+    double* scale; /* the diagonal of D^(-0.5) */
+    PMATRIX h; /* the H of the last fit: n_fitXk for the n_fit points then, NULL before the first fit */
+    PMATRIX scaled_h; /* D^(-0.5)*H: scratch of the product, nXk */
+} SYMNMF_STREAM;
+typedef SYMNMF_STREAM* PSYMNMF_STREAM;
+
+/* The update rules symnmf_solve_with can iterate */
+typedef enum _SYMNMF_SOLVER
+{
+    SOLVER_MU = 0, /* the damped multiplicative update of the algorithm */
+    SOLVER_MOMENTUM_MU, /* the multiplicative update from a Nesterov extrapolation of the last two H, restarted when the residual grows */
+    SOLVER_HALS, /* coordinate descent over the columns of H and of a copy G, for ||W - H*G^T||^2 + alpha*||H - G||^2 */
+    SOLVER_ANLS, /* the same splitting, each half solved as nonnegative least squares by projected gradient */
+
+    /* Must be last */
+    SOLVER_COUNT
+} SYMNMF_SOLVER;
+
+/* When symnmf_solve_with stops, besides max_iter and the target residual */
+typedef enum _STOP_CRITERION
+{
+    STOP_ON_DELTA = 0, /* ||H(i+1) - H(i)||^2 < epsilon, the criterion of the algorithm */
+    STOP_ON_OBJECTIVE, /* ||W - H*H^T||^2 moved by less than epsilon (relative) since the last check */
+
+    /* Must be last */
+    STOP_COUNT
+} STOP_CRITERION;
+
+/* The initial centroids of kmeans */
+typedef enum _KMEANS_INIT
+{
+    KMEANS_INIT_FIRST = 0, /* the first k points, like the analysis */
+    KMEANS_INIT_PLUS_PLUS, /* k-means++: every next centroid drawn with probability proportional to the squared distance to the closest one so far */
+
+    /* Must be last */
+    KMEANS_INIT_COUNT
+} KMEANS_INIT;
+
+/* The runtime parameters of a solve, default_params gives those of the algorithm */
+typedef struct _SYMNMF_PARAMS
+{
+    SYMNMF_SOLVER solver;
+    double beta; /* damping of the multiplicative update */
+    double epsilon; /* tolerance of the criterion */
+    int max_iter;
+    STOP_CRITERION criterion;
+    int check_interval; /* the criterion is looked at every check_interval iterations only */
+    double target_residual; /* also stop once ||W - H*H^T||^2 is at most this, if > 0 */
+    double split_penalty; /* alpha of SOLVER_HALS and SOLVER_ANLS */
+    int inner_steps; /* projected gradient steps per half iteration of SOLVER_ANLS */
+} SYMNMF_PARAMS;
+typedef SYMNMF_PARAMS* PSYMNMF_PARAMS;
+
+typedef struct _SOLVER_REPORT
+{
+    int iterations;
+    int converged; /* stopped by the criterion or by the target residual, not by max_iter */
+    double seconds; /* wall time of the iterations */
+    double residual; /* ||W - H*H^T||_F^2 of the final H */
+} SOLVER_REPORT;
+typedef SOLVER_REPORT* PSOLVER_REPORT;
+
+/* One k of symnmf_sweep */
+typedef struct _SWEEP_RESULT
+{
+    int k;
+    int warm_started; /* the kept H came from the split of the k before, not from a cold start */
+    SOLVER_REPORT report; /* the iterations of the kept H alone, and its residual */
+    double score; /* mean euclidean silhouette of the argmax clusters of H, in [-1, 1] (higher is better) */
+} SWEEP_RESULT;
+typedef SWEEP_RESULT* PSWEEP_RESULT;
+
+/* The stages of the pipeline run_benchmark times, in order (every stage starts from the outputs of the ones before) */
+typedef enum _BENCH_STAGE
+{
+    BENCH_SYM = 0, /* X -> A */
+    BENCH_DDG, /* A -> D */
+    BENCH_NORM, /* A, D -> W */
+    BENCH_MAT_MULT, /* W*H_0 */
+    BENCH_SYMNMF, /* a fixed number of iterations of the update from H_0 */
+
+    /* Must be last */
+    BENCH_STAGE_COUNT
+} BENCH_STAGE;
+
+/* One scale of run_benchmark: the synthetic points and the output of every stage */
+typedef struct _BENCH_STATE
+{
+    int n;
+    int d;
+    int k;
+    PMATRIX points; /* X: nXd */
+    PMATRIX sim; /* A: nXn */
+    PMATRIX diagonal; /* D: nXn */
+    PMATRIX normalized; /* W: nXn */
+    PMATRIX initial_h; /* H_0: nXk */
+    PMATRIX product; /* W*H_0: nXk */
+    PMATRIX updated_h; /* nXk */
+    SOLVER_REPORT report; /* of the symnmf stage */
+} BENCH_STATE;
+typedef BENCH_STATE* PBENCH_STATE;
+
+typedef struct _SYMNMF_CONTEXT
+{
+    W_OPERATOR normalized; /* W: nXn */
+    SYMNMF_PARAMS params;
+    PMATRIX h[2]; /* H(i) and H(i+1): nXk, the iterations ping-pong between them */
+    int current; /* index of the current H in h */
+    PMATRIX numerator; /* W*H: nXk */
+    PMATRIX gram; /* H^T*H: kXk */
+    PMATRIX denominator; /* H*H^T*H: nXk */
+    PMATRIX auxiliary; /* the extrapolated H of SOLVER_MOMENTUM_MU, or G of SOLVER_HALS and SOLVER_ANLS: nXk */
+    PGEMM_WORKSPACE gemm_workspace;
+    double squared_norm; /* ||W||_F^2 */
+    double residual; /* ||W - H*H^T||_F^2 of the H the last product was taken at, fused into the update */
+    double momentum; /* t of Nesterov's sequence, 1 after a restart */
+} SYMNMF_CONTEXT;
+typedef SYMNMF_CONTEXT* PSYMNMF_CONTEXT;
+
+/* One iteration of a solver: H(i) -> H(i+1), and delta = ||H(i+1) - H(i)||^2 */
+typedef int (*SOLVER_STEP)(PSYMNMF_CONTEXT context, double* pdelta);
+
+/* The header of a binary matrix file, followed by rows X stride elements of dtype (native byte order).
+Its size is a whole number of aligned blocks, so the mapped rows are laid out like the rows of create_matrix */
+#define MATRIX_FILE_MAGIC "SYMNMFMX"
+#define MATRIX_FILE_MAGIC_SIZE (8)
+#define MATRIX_FILE_VERSION (1)
+#define MATRIX_DTYPE_FLOAT64 (1)
+#define MATRIX_DTYPE_FLOAT32 (2)
+#ifdef SYMNMF_FLOAT32
+#define MATRIX_DTYPE_REAL MATRIX_DTYPE_FLOAT32
+#else
+#define MATRIX_DTYPE_REAL MATRIX_DTYPE_FLOAT64
+#endif
+typedef struct _MATRIX_FILE_HEADER
+{
+    char magic[MATRIX_FILE_MAGIC_SIZE];
+    int version;
+    int dtype;
+    int rows;
+    int cols;
+    int stride;
+    char reserved[MATRIX_ALIGNMENT - MATRIX_FILE_MAGIC_SIZE - 5 * sizeof(int)];
+} MATRIX_FILE_HEADER;
+
+/* The state of the MT19937 generator that initializes H (random.c) */
+#define MT_N (624)
+typedef struct _RANDOM_STATE
+{
+    unsigned long mt[MT_N];
+    int index;
+} RANDOM_STATE;
+typedef RANDOM_STATE* PRANDOM_STATE;
+
 typedef enum _ARGS
 {
 	ARGS_SELF = 0,
 	ARGS_GOAL,
     ARGS_FILE_NAME,
+    ARGS_THREADS, /* optional */
 
 	/* Must be last */ 
 	ARGS_COUNT
 } ARGS;
 
+#define ARGS_REQUIRED (ARGS_THREADS)
+#define ARGS_OUTPUT_FILE_NAME (ARGS_THREADS) /* the convert goal takes an output file instead */
+
 /* MATH HELPER FUNCTIONS */
-double find_sq_euc_dist(double* point1, double* point2, int d); /* finds squared euclidian distance between two points */
-double find_exp(double* point1, double* point2, int d); /* finds the exp function as described in algorithm: e^( - sq_euc_dist / 2) */
-int mat_mult(PMATRIX A, PMATRIX B, PMATRIX* pres); /* matrix multiplication function - Receives A: n*k, B: k*m. Returns A*B: n*m */
-int subtract_matrices(PMATRIX A, PMATRIX B, PMATRIX* pres); /* Assumes that matrices are of same dimensions */
-void pow_diag(PMATRIX M, double a); /* receives a diagonal matrix M and changes it in-place to be M^a */
+double find_sq_euc_dist(REAL* point1, REAL* point2, int d); /* finds squared euclidian distance between two points */
+double find_exp(REAL* point1, REAL* point2, int d); /* finds the exp function as described in algorithm: e^( - sq_euc_dist / 2) */
+int mat_mult(PMATRIX A, PMATRIX B, PMATRIX* pres); /* matrix multiplication function - Receives A: n*k, B: k*m. Returns A*B: n*m (allocated) */
 double calculate_cell(double numerator, double denominator, double H_ij, double beta);
-int squared_frob_norm(PMATRIX A, PMATRIX B, double* result); /* calculates squared frobenius norm */
+double squared_frob_norm(PMATRIX A, PMATRIX B); /* calculates the squared frobenius norm of A-B, without allocating it */
 
 /* SYMNMF FUNCTIONS */
 int sym(PMATRIX initial, PMATRIX* psim); /* X -> A */
 int ddg(PMATRIX sim, PMATRIX* pdiagonal); /* A -> D */
+int sym_ddg(PMATRIX initial, PMATRIX* psim, double** pdegrees); /* X -> A and the degrees (diagonal of D) in one pass */
 int norm(PMATRIX sim, PMATRIX diagonal, PMATRIX* pnormalized); /* D -> W */
+double norm_in_place(PMATRIX sim, double* degrees); /* A -> W in place, in O(n^2). degrees become the diagonal of D^(-0.5). Returns the sum of W */
 int symnmf(PMATRIX initial_h, PMATRIX normalized, PMATRIX* pupdated_h); /* H_0,W -> H_final */
+int symnmf_solve(PW_OPERATOR normalized, PMATRIX initial_h, PMATRIX* pupdated_h); /* H_0,W -> H_final for any representation of W */
+int symnmf_solve_with(PW_OPERATOR normalized, PMATRIX initial_h, PSYMNMF_PARAMS params, PMATRIX* pupdated_h, PSOLVER_REPORT report); /* symnmf_solve with other parameters (solver, stopping). report may be NULL */
+int symnmf_fit(PMATRIX initial, int k, unsigned long seed, PMATRIX* ph, PMATRIX* pnormalized); /* X -> H_final: sym, ddg, norm, H_0 and the iterations. Optionally returns W too */
+int symnmf_fit_restarts(PMATRIX initial, int k, unsigned long* seeds, int restarts, int workers, PMATRIX* ph, int* pbest, PSOLVER_REPORT report); /* symnmf_fit from every seed concurrently on a shared W (0 workers for one per core), keeps the H of the lowest residual */
+int symnmf_fit_operator(PW_OPERATOR normalized, int n, int k, unsigned long seed, PMATRIX* ph); /* H_0 and the iterations for a W only seen through its products */
+int initialize_h(PW_OPERATOR normalized, int n, int k, unsigned long seed, PMATRIX* pinitial_h); /* H_0 ~ U[0, 2*sqrt(mean(W)/k)) drawn like np.random.seed(seed) */
+int symnmf_fit_batch(PMATRIX* points, int* ks, int jobs, unsigned long seed, int workers, PMATRIX* hs); /* symnmf_fit of many independent jobs on a team of workers (0 for one per core), returns the number of failed jobs */
+
+/* GEMM FUNCTIONS (gemm.c) */
+int create_gemm_workspace(PGEMM_WORKSPACE* pworkspace); /* allocates the packing buffers of the blocked engine */
+void free_gemm_workspace(PGEMM_WORKSPACE workspace); /* frees the packing buffers */
+int gemm(PMATRIX A, PMATRIX B, PMATRIX C, PGEMM_WORKSPACE workspace); /* C = A*B into a preallocated n*m C. workspace may be NULL */
+int gram(PMATRIX H, PMATRIX G); /* G = H^T*H into a preallocated k*k G, without transposing H */
+void mult_small(PMATRIX A, PMATRIX B, PMATRIX C); /* C = A*B for a tall A: n*k and a small B: k*m, into a preallocated n*m C */
+
+/* SPARSE FUNCTIONS (sparse.c) */
+int create_csr(int rows, int cols, size_t capacity, PCSR_MATRIX* pcsr); /* creates an empty CSR matrix with room for capacity entries */
+void free_csr(PCSR_MATRIX csr); /* frees the memory for a CSR matrix */
+int sym_knn(PMATRIX initial, int knn, double threshold, PCSR_MATRIX* psim, double** pdegrees); /* X -> the symmetrized knn graph A (entries >= threshold) and its degrees */
+void csr_norm_in_place(PCSR_MATRIX sim, double* degrees); /* A -> W in place. degrees become the diagonal of D^(-0.5) */
+void spmm(PCSR_MATRIX W, PMATRIX H, PMATRIX WH); /* WH = W*H into a preallocated nXk WH */
+void sparse_operator(PCSR_MATRIX normalized, PW_OPERATOR op); /* wraps a CSR W for the solver */
+int csr_to_dense(PCSR_MATRIX csr, PMATRIX* pdense); /* expands a CSR matrix, for output */
+int symnmf_sparse(PMATRIX initial_h, PCSR_MATRIX normalized, PMATRIX* pupdated_h); /* H_0,W -> H_final for a CSR W */
+
+/* OUT-OF-CORE FUNCTIONS (outofcore.c) */
+int sym_tiles(PMATRIX initial, char* scratch_dir, PW_TILES* ptiles); /* X -> A in a scratch file under scratch_dir, tile by tile, and the diagonal of D^(-0.5) */
+void free_tiles(PW_TILES tiles); /* unmaps A (its file is gone with it) and frees the tiles */
+void tiled_operator(PW_TILES tiles, PW_OPERATOR op); /* wraps the tiles for the solver, every product streams A once */
+int symnmf_fit_out_of_core(PMATRIX initial, int k, unsigned long seed, char* scratch_dir, PMATRIX* ph); /* symnmf_fit with W out of core */
+
+/* NYSTROM FUNCTIONS (nystrom.c) */
+int sym_nystrom(PMATRIX initial, int m, unsigned long seed, PW_NYSTROM* pnystrom); /* X -> the low-rank W from m landmarks drawn with seed */
+void free_nystrom(PW_NYSTROM nystrom); /* frees the factors */
+void nystrom_operator(PW_NYSTROM nystrom, PW_OPERATOR op); /* wraps the factors for the solver, a product costs O(n*r*k) */
+int nystrom_error(PMATRIX initial, int m, unsigned long seed, double* perror); /* ||W_nystrom - W||_F / ||W||_F against the exact W, for small n */
+int symnmf_fit_nystrom(PMATRIX initial, int k, int m, unsigned long seed, PMATRIX* ph); /* symnmf_fit with the low-rank W */
+
+/* STREAM FUNCTIONS (stream.c) */
+int create_stream(int d, int k, unsigned long seed, PSYMNMF_STREAM* pstream); /* an empty stream of d-dimensional points, clustered into k */
+void free_stream(PSYMNMF_STREAM stream); /* frees the stream and its state */
+int stream_append(PSYMNMF_STREAM stream, PMATRIX points); /* adds the rows and columns of the new points to A, and updates the degrees */
+void stream_operator(PSYMNMF_STREAM stream, PW_OPERATOR op); /* wraps the stream's A and degrees for the solver */
+int stream_fit(PSYMNMF_STREAM stream, PSYMNMF_PARAMS params, PSOLVER_REPORT report); /* the iterations from the last H (random rows for the new points), into stream->h. report may be NULL */
+
+/* K SWEEP FUNCTIONS (sweep.c) */
+int symnmf_sweep(PMATRIX initial, int k_min, int k_max, unsigned long seed, int cold_starts, PMATRIX* hs, PSWEEP_RESULT results); /* W once, then H and a result for every k in k_min..k_max, warm-started from the k before (and with cold_starts, the better of that and a cold start) */
+
+/* EVALUATION FUNCTIONS (silhouette.c) */
+void assign_clusters(PMATRIX H, int* labels); /* the cluster of every point: the argmax of its row of H (the first one on ties) */
+int silhouette(PMATRIX points, int* labels, int k, double* pscore); /* the mean euclidean silhouette of the labels in 0..k-1, in tiles (no nXn distances) */
+
+/* K-MEANS FUNCTIONS (kmeans.c) */
+int kmeans(PMATRIX points, int k, KMEANS_INIT init, unsigned long seed, int* labels, PMATRIX* pcentroids, int* piterations); /* the clusters of kmeans.py, pruned by Hamerly's bounds. seed is for KMEANS_INIT_PLUS_PLUS */
+
+/* BENCHMARK FUNCTIONS (bench.c) */
+int gaussian_clusters(int n, int d, int k, unsigned long seed, PMATRIX* ppoints); /* n points around k random centers in d dimensions, with unit normal noise */
+int run_benchmark(char* json_file_name); /* times every stage at several n/d/k, prints a summary and writes the results as JSON */
+
+/* SIMD FUNCTIONS (simd.c) */
+void init_sim_kernel(void); /* selects the kernel of get_sim_kernel once, call it before starting any thread */
+SIM_ROW_KERNEL get_sim_kernel(void); /* the widest similarity row kernel this CPU supports (AVX-512, AVX2 or scalar) */
+int prepare_points(PMATRIX points, PMATRIX* ppoints_t, double** pnorms); /* X -> X^T and the squared norm of every point */
+int sim_tile_columns(int d); /* number of columns per tile, so a tile of the transposed points stays in L1 */
+int pairwise_exp(PMATRIX points, PMATRIX sim, double* degrees); /* sim[i][j] = e^(-||x_i - x_j||^2 / 2) over the upper triangle, mirrored. Optionally the row sums into degrees */
+
+/* RANDOM FUNCTIONS (random.c) */
+void seed_random(PRANDOM_STATE state, unsigned long seed); /* seeds MT19937 like np.random.seed(seed) */
+double next_random_double(PRANDOM_STATE state); /* a uniform double in [0, 1), like np.random.random_sample() */
+void fill_uniform(PMATRIX matrix, double high, unsigned long seed); /* fills the matrix like np.random.seed(seed); np.random.uniform(0, high, shape) */
+
+/* THREADING FUNCTIONS - the kernels are parallelized with OpenMP (build without -fopenmp for a serial build) */
+void set_thread_count(int threads); /* sets the number of threads for the following computations, 0 means one per core */
+int get_thread_count(void); /* the number of threads the following computations will use */
+int get_thread_index(void); /* index of the calling thread within the current parallel region */
+double get_wall_time(void); /* seconds on a monotonic clock, for timing */
 
 /* MATRIX FUNCTIONS */
+void* heap_alloc_aligned(size_t size); /* allocates a zero-ed buffer of size bytes aligned to MATRIX_ALIGNMENT, free with HEAPFREE */
 int create_matrix(int rows, int cols, PMATRIX* pmatrix); /* creates a new empty zero-ed matrix with dimensions rows X cols */
 int transpose_matrix(PMATRIX matrix, PMATRIX* ptransposed); /* gets a matrix and returns its transpose */
+void scale_rows(PMATRIX source, double* scale, PMATRIX target); /* target = diag(scale)*source, in place when target is source */
 void free_matrix(PMATRIX matrix); /* frees the memory for a matrix */
 void print_matrix(PMATRIX matrix); /* prints a matrix */
-int parse_file(char* file_name, int* n, int* d);
-int read_initial_from_file(char* file_name, PMATRIX matrix);
-int perform_iteration(PMATRIX prev, PMATRIX normalized, PMATRIX* pnew, double beta); /* receives H(i) (prev), W (norm) and beta, returns H(i+1) (new). H: nXk */
+int diagonal_from_degrees(double* degrees, int n, PMATRIX* pdiagonal); /* materializes the dense nXn D from its diagonal */
+
+/* MATRIX FILE FUNCTIONS (matio.c) */
+int load_matrix(char* file_name, PMATRIX* pmatrix); /* maps a binary matrix file, or parses a CSV file */
+int parse_csv_file(char* file_name, PMATRIX* pmatrix); /* parses a CSV file with all the threads, n and d are deduced from the file itself */
+int map_matrix_file(char* file_name, PMATRIX* pmatrix); /* maps a binary matrix file, the rows are used in place */
+void unmap_matrix(PMATRIX matrix); /* releases the mapping of a mapped matrix, called by free_matrix */
+int save_matrix_file(char* file_name, PMATRIX matrix); /* writes a matrix as a binary matrix file */
+
+/* SOLVER FUNCTIONS */
+void dense_operator(PMATRIX normalized, PW_OPERATOR op); /* wraps a dense W for the solver */
+void default_params(PSYMNMF_PARAMS params); /* the parameters of the algorithm: MU with the DEFAULT_ values, delta checked every iteration */
+int validate_params(PSYMNMF_PARAMS params); /* 0 if every parameter is in range */
+int create_symnmf_context(PW_OPERATOR normalized, PMATRIX initial_h, PSYMNMF_PARAMS params, PSYMNMF_CONTEXT* pcontext); /* allocates all the workspaces of the solver once, takes ownership of initial_h */
+void free_symnmf_context(PSYMNMF_CONTEXT context); /* frees the workspaces and the H buffers still owned */
+PMATRIX detach_current_h(PSYMNMF_CONTEXT context); /* transfers ownership of the current H to the caller */
+int perform_iteration(PSYMNMF_CONTEXT context, double* pdelta); /* H(i) -> H(i+1) in place of H(i-1), and delta = ||H(i+1) - H(i)||^2 */
+double residual_from_trace(PSYMNMF_CONTEXT context, double trace); /* ||W||^2 - 2*tr(H^T*W*H) + ||H^T*H||^2, from the trace and H^T*H in gram */
+double residual_from_products(PSYMNMF_CONTEXT context, PMATRIX H); /* the same, the trace summed from W*H in numerator */
+int measure_residual(PSYMNMF_CONTEXT context); /* the residual of the current H, at the cost of one more product */
+
+/* ACCELERATED SOLVERS (solvers.c) */
+int momentum_iteration(PSYMNMF_CONTEXT context, double* pdelta); /* SOLVER_MOMENTUM_MU */
+int hals_iteration(PSYMNMF_CONTEXT context, double* pdelta); /* SOLVER_HALS */
+int anls_iteration(PSYMNMF_CONTEXT context, double* pdelta); /* SOLVER_ANLS */
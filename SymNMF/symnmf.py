@@ -14,38 +14,72 @@ ARGS = {
     "FILE_NAME": 3,
 }
 
+MATRIX_FILE_MAGIC = b"SYMNMFMX"
+
+def read_points(file_name):
+    """
+    Reads the points for the C interface. A binary matrix file (see ./symnmf convert) is passed
+    to C by its path and mapped there, instead of being parsed here
+    """
+    with open(file_name, "rb") as f:
+        header = f.read(28)
+    if header[:8] == MATRIX_FILE_MAGIC:
+        version, dtype, n, d = np.frombuffer(header[8:24], dtype=np.int32)
+        return file_name, int(n), int(d)
+    # CSV files are parsed by the (multithreaded) C reader
+    points = np.asarray(symnmf_capi.load(file_name))
+    return points, points.shape[0], points.shape[1]
+
 def print_result(result):
     """
     Prints the result matrix in the appropriate way
     """
-    for line in result:
+    for line in np.asarray(result):
         format_coords = [f"{coord:.4f}" for coord in line]
         print(",".join(format_coords))
 
 def matrix_to_c(matrix):
     """
-    Converts the np array matrix to a list of lists for C interface
+    Converts the np array matrix to a contiguous nXd array of the element type of the C extension
+    (float64, or float32 in a single precision build) for C interface,
+    which the C extension takes through the buffer protocol (no copy)
     """
     n = matrix.shape[0]
     # We consider the edge case where the points are one-dimensional (d=1)
     d = matrix.shape[1] if len(matrix.shape) != 1 else 1
-    points = matrix.tolist()
-    if d == 1:
-        points = [[p] for p in points]
+    points = np.ascontiguousarray(matrix, dtype=symnmf_capi.dtype).reshape(n, d)
     return points, n, d
 
 def initialize_h(points, n, k, d):
     """
-    Initializes H and returns it together with W matrix (as list of lists for C interface)
+    Initializes H and returns it together with W matrix (W stays the C buffer, for C interface)
     """
     np.random.seed(0)
     W = symnmf_capi.norm(points, n, d)
-    wnp = np.array(W)
-    m = wnp.mean()
+    m = np.asarray(W).mean()
+    H = np.random.uniform(0, 2 * math.sqrt(m / k), (n, k))
+    hc, n, k = matrix_to_c(H)
+    return W, hc
+
+def symnmf_restarts(points, n, k, d, restarts):
+    """
+    Multi-start mode: the C iterations from the seeds 0..restarts-1 (0 is the single run of the symnmf goal),
+    run concurrently on a shared W. Returns the H with the lowest final residual
+    """
+    H, report = symnmf_capi.fit_restarts(points, n, d, k, list(range(restarts)))
+    return H
+
+def symnmf_knn(points, n, k, d, knn, threshold=0.0):
+    """
+    Sparse mode: W is the normalized graph of the knn most similar points of every point
+    (only those with similarity >= threshold), kept in CSR form. Returns the final H
+    """
+    np.random.seed(0)
+    indptr, indices, data = symnmf_capi.knn_norm(points, n, d, knn, threshold)
+    m = sum(data) / (n * n)
     H = np.random.uniform(0, 2 * math.sqrt(m / k), (n, k))
-    wc, n, n = matrix_to_c(wnp)
     hc, n, k = matrix_to_c(H)
-    return wc, hc
+    return symnmf_capi.symnmf_knn(indptr, indices, data, hc, n, k)
 
 if __name__ == "__main__":
     # Read arguments
@@ -57,8 +91,7 @@ if __name__ == "__main__":
     file_name = sys.argv[ARGS["FILE_NAME"]]
 
     # Parse the input file
-    X = np.loadtxt(file_name, delimiter=',')
-    points, n, d = matrix_to_c(X)
+    points, n, d = read_points(file_name)
 
     # Interface with C extension
     if goal == "sym":
@@ -68,8 +101,8 @@ if __name__ == "__main__":
     if goal == "norm":
         result = symnmf_capi.norm(points, n, d)
     if goal == "symnmf":
-        wc, hc = initialize_h(points, n, k, d)
-        result = symnmf_capi.symnmf(wc, hc, n, k)
+        # sym, ddg, norm, the initialization of H and the iterations all run in C
+        result = symnmf_capi.fit(points, n, d, k, 0)
 
     # Output result matrix
     print_result(result)
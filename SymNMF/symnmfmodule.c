@@ -1,17 +1,43 @@
-/* Python C API: The C extension which serves python. */
+/* Python C API: The C extension which serves python.
+The C computations run with the GIL released (Py_BEGIN_ALLOW_THREADS): they only touch C memory and the buffers
+held for the call, so other python threads keep running, and several calls can run at once */
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 #include "symnmf.h"
 
 
+/* TYPES */
+typedef struct _MATRIX_OBJECT
+{
+    PyObject_HEAD
+    PMATRIX matrix;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} MATRIX_OBJECT;
+
+static PyObject* matrix_type = NULL; /* symnmf_capi.Matrix */
+
+typedef struct _STREAM_OBJECT
+{
+    PyObject_HEAD
+    PSYMNMF_STREAM stream;
+    int busy; /* a call is running on the stream with the GIL released */
+} STREAM_OBJECT;
+
+static PyObject* stream_type = NULL; /* symnmf_capi.Stream */
+
 /* FUNCTIONS */
-int retrieve_points(PyObject* points, int n, int d, PMATRIX* pmatrix); /* from python list of points (list of list of coords) to C matrix */
-PyObject* build_points(PMATRIX matrix); /* converts the C matrix to a pythonic list of points */
+int retrieve_points(PyObject* points, int n, int d, Py_buffer* view, PMATRIX* pmatrix); /* from a buffer of the element type (numpy array), python list of points or the path of a binary matrix file, to C matrix */
+PyObject* build_points(PMATRIX* pmatrix); /* wraps the C matrix (taking ownership) in a python Matrix, which exports its buffer without a copy */
+void release_points(Py_buffer* view); /* releases the buffer borrowed by retrieve_points */
+int retrieve_csr(PyObject* indptr, PyObject* indices, PyObject* data, int n, PCSR_MATRIX* pcsr); /* from python CSR lists to a C CSR matrix */
+PyObject* build_csr(PCSR_MATRIX csr); /* converts the C CSR matrix to a pythonic (indptr, indices, data) tuple */
 
 static PyObject* sym_wrapper(PyObject* self, PyObject* args)
 {
     int status = -1;
     PyObject* value = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
     PyObject* points = NULL; /* This will later be converted to a matrix */
     int n, d = 0;
     PMATRIX initial = NULL;
@@ -26,7 +52,7 @@ static PyObject* sym_wrapper(PyObject* self, PyObject* args)
     }
 
     /* Retrieve points: from python to c matrix of type PMATRIX */
-    status = retrieve_points(points, n, d, &initial);
+    status = retrieve_points(points, n, d, &view, &initial);
     if (status == 1)
     {
         printf("An Error Has Occurred\n");
@@ -34,7 +60,9 @@ static PyObject* sym_wrapper(PyObject* self, PyObject* args)
     }
 
     /* sym phase: getting the similarity matrix A from initial matrix X */
+    Py_BEGIN_ALLOW_THREADS
     status = sym(initial, &sim);
+    Py_END_ALLOW_THREADS
     if (status == 1)
     {
         printf("An Error Has Occurred\n");
@@ -42,11 +70,12 @@ static PyObject* sym_wrapper(PyObject* self, PyObject* args)
     }
 
     /* C -> Python: This builds the answer back into a python object */
-    value = build_points(sim);
+    value = build_points(&sim);
 
 lblCleanup:
     free_matrix(initial);
     free_matrix(sim);
+    release_points(&view); /* after the matrix that borrows it */
     return value;
 }
 
@@ -54,8 +83,10 @@ static PyObject* ddg_wrapper(PyObject* self, PyObject* args)
 {
     int status = -1;
     PyObject* value = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
     PyObject* points = NULL; /* This will later be converted to a matrix */
     int n, d = 0;
+    double* degrees = NULL;
     PMATRIX initial = NULL;
     PMATRIX sim = NULL;
     PMATRIX diagonal = NULL;
@@ -69,23 +100,27 @@ static PyObject* ddg_wrapper(PyObject* self, PyObject* args)
     }
 
     /* Retrieve points: from python to c matrix of type PMATRIX */
-    status = retrieve_points(points, n, d, &initial);
+    status = retrieve_points(points, n, d, &view, &initial);
     if (status != 0)
     {
         printf("An Error Has Occurred\n");
         goto lblCleanup;
     }
 
-    /* sym phase: getting the similarity matrix A from initial matrix X */
-    status = sym(initial, &sim);
+    /* sym and ddg phases: getting the similarity matrix A and the degrees from initial matrix X in one pass */
+    Py_BEGIN_ALLOW_THREADS
+    status = sym_ddg(initial, &sim, &degrees);
+    Py_END_ALLOW_THREADS
     if (status != 0)
     {
         printf("An Error Has Occurred\n");
         goto lblCleanup;
     }
 
-    /* ddg phase: getting the diagonal matrix D from sim matrix A */
-    status = ddg(sim, &diagonal);
+    /* ddg phase: getting the diagonal matrix D from the degrees */
+    Py_BEGIN_ALLOW_THREADS
+    status = diagonal_from_degrees(degrees, n, &diagonal);
+    Py_END_ALLOW_THREADS
     if (status == 1)
     {
         printf("An Error Has Occurred\n");
@@ -93,13 +128,15 @@ static PyObject* ddg_wrapper(PyObject* self, PyObject* args)
     }
 
     /* C -> Python: This builds the answer back into a python object */
-    value = build_points(diagonal);
+    value = build_points(&diagonal);
 
     
 lblCleanup:
     free_matrix(initial);
     free_matrix(sim);
+    HEAPFREE(degrees);
     free_matrix(diagonal);
+    release_points(&view); /* after the matrix that borrows it */
     return value;
 }
 
@@ -107,12 +144,12 @@ static PyObject* norm_wrapper(PyObject* self, PyObject* args)
 {
     int status = -1;
     PyObject* value = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
     PyObject* points = NULL; /* This will later be converted to a matrix */
     int n, d = 0;
+    double* degrees = NULL;
     PMATRIX initial = NULL;
     PMATRIX sim = NULL;
-    PMATRIX diagonal = NULL;
-    PMATRIX normalized = NULL;
 
     /* Python -> C */
     /* Parse the Python arguments into the appropriate data types */
@@ -123,46 +160,37 @@ static PyObject* norm_wrapper(PyObject* self, PyObject* args)
     }
 
     /* Retrieve points: from python to c matrix of type PMATRIX */
-    status = retrieve_points(points, n, d, &initial);
+    status = retrieve_points(points, n, d, &view, &initial);
     if (status != 0)
     {
         printf("An Error Has Occurred\n");
         goto lblCleanup;
     }
 
-    /* sym phase: getting the similarity matrix A from initial matrix X */
-    status = sym(initial, &sim);
+    /* sym and ddg phases: getting the similarity matrix A and the degrees from initial matrix X in one pass */
+    Py_BEGIN_ALLOW_THREADS
+    status = sym_ddg(initial, &sim, &degrees);
+    Py_END_ALLOW_THREADS
     if (status != 0)
     {
         printf("An Error Has Occurred\n");
         goto lblCleanup;
     }
 
-    /* ddg phase: getting the diagonal matrix D from sim matrix A */
-    status = ddg(sim, &diagonal);
-    if (status == 1)
-    {
-        printf("An Error Has Occurred\n");
-        goto lblCleanup;
-    }
-
-    /* norm phase: getting W from D and A */
-    status = norm(sim, diagonal, &normalized);
-    if (status == 1)
-    {
-        printf("An Error Has Occurred\n");
-        goto lblCleanup;
-    }
+    /* norm phase: getting W from the degrees and A, in place */
+    Py_BEGIN_ALLOW_THREADS
+    (void)norm_in_place(sim, degrees);
+    Py_END_ALLOW_THREADS
 
     /* C -> Python: This builds the answer back into a python object */
-    value = build_points(normalized);
+    value = build_points(&sim);
 
     
 lblCleanup:
     free_matrix(initial);
     free_matrix(sim);
-    free_matrix(diagonal);
-    free_matrix(normalized);
+    HEAPFREE(degrees);
+    release_points(&view); /* after the matrix that borrows it */
     return value;
 }
 
@@ -171,6 +199,7 @@ static PyObject* symnmf_wrapper(PyObject* self, PyObject* args)
 {
     int status = -1;
     PyObject* value = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
     PyObject* w_points = NULL; 
     PyObject* h_points = NULL; 
     int n, k = 0;
@@ -187,21 +216,23 @@ static PyObject* symnmf_wrapper(PyObject* self, PyObject* args)
     }
 
     /* Retrieve points: from python to c matrix of type PMATRIX */
-    status = retrieve_points(w_points, n, n, &normalized);
+    status = retrieve_points(w_points, n, n, &view, &normalized);
     if (status == 1)
     {
         printf("An Error Has Occurred\n");
         goto lblCleanup;
     }
 
-    status = retrieve_points(h_points, n, k, &initial_h);
+    status = retrieve_points(h_points, n, k, NULL, &initial_h); /* a copy, the solver updates it in place */
     if (status == 1)
     {
         printf("An Error Has Occurred\n");
         goto lblCleanup;
     }
 
+    Py_BEGIN_ALLOW_THREADS
     status = symnmf(initial_h, normalized, &updated_h);
+    Py_END_ALLOW_THREADS
     initial_h = NULL;
     if (status == 1)
     {
@@ -211,101 +242,1531 @@ static PyObject* symnmf_wrapper(PyObject* self, PyObject* args)
     
 
     /* C -> Python: This builds the answer back into a python object */
-    value = build_points(updated_h);
+    value = build_points(&updated_h);
 
 lblCleanup:
     free_matrix(normalized);
     free_matrix(initial_h);
     free_matrix(updated_h);
+    release_points(&view); /* after the matrix that borrows it */
     return value;
 }
 
-static PyMethodDef symnmfMethods[] = {
-    {"sym", (PyCFunction)sym_wrapper, METH_VARARGS, PyDoc_STR("sym: constructing the similarity matrix")}, /* sym() */
-    {"ddg", (PyCFunction)ddg_wrapper, METH_VARARGS, PyDoc_STR("ddg: constructing the diagonal degree matrix")}, /* ddg() */
-    {"norm", (PyCFunction)norm_wrapper, METH_VARARGS, PyDoc_STR("norm: constructing the normalized matrix")}, /* norm() */
-    {"symnmf", (PyCFunction)symnmf_wrapper, METH_VARARGS, PyDoc_STR("symnmf: getting the final H")}, /* symnmf() */
-    {NULL, NULL, 0, NULL}
-};
+static int params_from_names(const char* solver_name, const char* criterion_name, PSYMNMF_PARAMS params)
+{
+    /* The solver and criterion names, indexed by SYMNMF_SOLVER and STOP_CRITERION */
+    static const char* solver_names[SOLVER_COUNT] = { "mu", "momentum", "hals", "anls" };
+    static const char* criterion_names[STOP_COUNT] = { "delta", "objective" };
+    int solver, criterion = 0;
 
-static struct PyModuleDef symnmfmodule =
+    for (solver = 0; solver < SOLVER_COUNT; solver++)
+        if (strcmp(solver_name, solver_names[solver]) == 0)
+            break;
+    for (criterion = 0; criterion < STOP_COUNT; criterion++)
+        if (strcmp(criterion_name, criterion_names[criterion]) == 0)
+            break;
+    if (solver == SOLVER_COUNT || criterion == STOP_COUNT)
+        return 1;
+
+    params->solver = (SYMNMF_SOLVER)solver;
+    params->criterion = (STOP_CRITERION)criterion;
+    return validate_params(params);
+}
+
+static PyObject* mat_mult_wrapper(PyObject* self, PyObject* args)
 {
-    PyModuleDef_HEAD_INIT, 
-    "symnmf_capi", /* name of module */
-    NULL, /* module documentation */
-    -1, /* size of per-interpreter state of the module, or -1 if the module keeps state in global variables. */
-    symnmfMethods /* the PyMethodDef array from before containing the methods of the extension */
-};
+    int status = -1;
+    PyObject* value = NULL;
+    Py_buffer a_view = { 0 }; /* the buffers the input matrices may borrow */
+    Py_buffer b_view = { 0 };
+    PyObject* a_points = NULL;
+    PyObject* b_points = NULL;
+    int n, k, m = 0;
+    PMATRIX a = NULL;
+    PMATRIX b = NULL;
+    PMATRIX product = NULL;
 
-PyMODINIT_FUNC PyInit_symnmf_capi(void)
+    /* Python -> C */
+    /* Parse the Python arguments into the appropriate data types */
+    if (!PyArg_ParseTuple(args, "OOiii", &a_points, &b_points, &n, &k, &m)) 
+    {
+        return NULL;
+    }
+
+    /* Retrieve points: from python to c matrices of type PMATRIX */
+    status = retrieve_points(a_points, n, k, &a_view, &a);
+    if (status == 0)
+        status = retrieve_points(b_points, k, m, &b_view, &b);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    status = mat_mult(a, b, &product);
+    Py_END_ALLOW_THREADS
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* C -> Python */
+    value = build_points(&product);
+
+lblCleanup:
+    free_matrix(a);
+    free_matrix(b);
+    free_matrix(product);
+    release_points(&a_view); /* after the matrices that borrow them */
+    release_points(&b_view);
+    return value;
+}
+
+static PyObject* solve_wrapper(PyObject* self, PyObject* args, PyObject* kwargs)
 {
-    PyObject *m;
-    m = PyModule_Create(&symnmfmodule);
-    if (!m)
+    static char* keywords[] = { "W", "H", "n", "k", "solver", "target_residual", "beta", "epsilon", "max_iter",
+        "check_interval", "criterion", NULL };
+    int status = -1;
+    PyObject* value = NULL;
+    PyObject* python_h = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
+    PyObject* w_points = NULL; 
+    PyObject* h_points = NULL; 
+    const char* solver_name = NULL;
+    const char* criterion_name = "delta";
+    int n, k = 0;
+    SYMNMF_PARAMS params;
+    SOLVER_REPORT report = { 0 };
+    W_OPERATOR op;
+    PMATRIX normalized = NULL;
+    PMATRIX initial_h = NULL;
+    PMATRIX updated_h = NULL;
+
+    /* Python -> C */
+    /* Parse the Python arguments into the appropriate data types */
+    (void)default_params(&params);
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOiis|dddiis", keywords, &w_points, &h_points, &n, &k, &solver_name,
+        &params.target_residual, &params.beta, &params.epsilon, &params.max_iter, &params.check_interval, &criterion_name)) 
+    {
         return NULL;
-    return m;
+    }
+
+    if (params_from_names(solver_name, criterion_name, &params) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* Retrieve points: from python to c matrix of type PMATRIX */
+    status = retrieve_points(w_points, n, n, &view, &normalized);
+    if (status == 1)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    status = retrieve_points(h_points, n, k, NULL, &initial_h); /* a copy, the solver updates it in place */
+    if (status == 1)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    (void)dense_operator(normalized, &op);
+    status = symnmf_solve_with(&op, initial_h, &params, &updated_h, &report);
+    Py_END_ALLOW_THREADS
+    initial_h = NULL;
+    if (status == 1)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* C -> Python: the final H and the report as a dict */
+    python_h = build_points(&updated_h);
+    if (python_h != NULL)
+        value = Py_BuildValue("(O{s:i,s:O,s:d,s:d})", python_h,
+            "iterations", report.iterations, "converged", report.converged ? Py_True : Py_False,
+            "seconds", report.seconds, "residual", report.residual);
+    Py_XDECREF(python_h);
+
+lblCleanup:
+    free_matrix(normalized);
+    free_matrix(initial_h);
+    free_matrix(updated_h);
+    release_points(&view); /* after the matrix that borrows it */
+    return value;
 }
 
-int retrieve_points(PyObject* points, int n, int d, PMATRIX* pmatrix)
+static PyObject* fit_wrapper(PyObject* self, PyObject* args)
 {
     int status = -1;
-    PMATRIX matrix = NULL;
-    PyObject* point = NULL;
-    PyObject* coord_object = NULL;
-    double coord = 0;
-    int i, j = 0;
+    PyObject* value = NULL;
+    PyObject* python_h = NULL;
+    PyObject* python_w = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
+    PyObject* points = NULL; /* This will later be converted to a matrix */
+    int n, d, k = 0;
+    int return_w = 0;
+    unsigned long seed = 0;
+    PMATRIX initial = NULL;
+    PMATRIX normalized = NULL;
+    PMATRIX updated_h = NULL;
 
-    /* create a new empty initial matrix */
-    status = create_matrix(n, d, &matrix);
+    /* Python -> C */
+    /* Parse the Python arguments into the appropriate data types */
+    if (!PyArg_ParseTuple(args, "Oiiik|p", &points, &n, &d, &k, &seed, &return_w)) 
+    {
+        return NULL;
+    }
+
+    /* Retrieve points: from python to c matrix of type PMATRIX */
+    status = retrieve_points(points, n, d, &view, &initial);
+    if (status != 0 || k < 1)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* X -> H_final, W stays in C unless it was asked for */
+    Py_BEGIN_ALLOW_THREADS
+    status = symnmf_fit(initial, k, seed, &updated_h, return_w ? &normalized : NULL);
+    Py_END_ALLOW_THREADS
     if (status != 0)
     {
         printf("An Error Has Occurred\n");
         goto lblCleanup;
     }
 
-    /* fill the matrix with coords */
-    for (i = 0; i < n; i++) 
+    /* C -> Python: This builds the answer back into a python object */
+    python_h = build_points(&updated_h);
+    if (!return_w)
     {
-        point = PyList_GetItem(points, i);
-        for (j = 0; j < d; j++) 
-        {
-            coord_object = PyList_GetItem(point, j);
-            coord = PyFloat_AsDouble(coord_object);
-            matrix->coords[i][j] = coord;
-        }
+        value = python_h;
+        goto lblCleanup;
     }
+    python_w = build_points(&normalized);
+    if (python_h != NULL && python_w != NULL)
+        value = Py_BuildValue("(OO)", python_h, python_w);
+    Py_XDECREF(python_h);
+    Py_XDECREF(python_w);
 
-    /* Transfer ownership */
-    *pmatrix = matrix;
-    matrix = NULL;
+lblCleanup:
+    free_matrix(initial);
+    free_matrix(normalized);
+    free_matrix(updated_h);
+    release_points(&view); /* after the matrix that borrows it */
+    return value;
+}
 
-    status = 0;
+static PyObject* fit_out_of_core_wrapper(PyObject* self, PyObject* args)
+{
+    int status = -1;
+    PyObject* value = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
+    PyObject* points = NULL; /* This will later be converted to a matrix */
+    int n, d, k = 0;
+    unsigned long seed = 0;
+    char* scratch_dir = NULL;
+    PMATRIX initial = NULL;
+    PMATRIX updated_h = NULL;
+
+    /* Python -> C */
+    /* Parse the Python arguments into the appropriate data types */
+    if (!PyArg_ParseTuple(args, "Oiiiks", &points, &n, &d, &k, &seed, &scratch_dir)) 
+    {
+        return NULL;
+    }
+
+    /* Retrieve points: from python to c matrix of type PMATRIX */
+    status = retrieve_points(points, n, d, &view, &initial);
+    if (status != 0 || k < 1)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* X -> H_final, with A in a scratch file under scratch_dir */
+    Py_BEGIN_ALLOW_THREADS
+    status = symnmf_fit_out_of_core(initial, k, seed, scratch_dir, &updated_h);
+    Py_END_ALLOW_THREADS
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* C -> Python: This builds the answer back into a python object */
+    value = build_points(&updated_h);
 
 lblCleanup:
-    free_matrix(matrix);
-    return status;
+    free_matrix(initial);
+    free_matrix(updated_h);
+    release_points(&view); /* after the matrix that borrows it */
+    return value;
 }
 
-PyObject* build_points(PMATRIX matrix)
+static PyObject* fit_nystrom_wrapper(PyObject* self, PyObject* args)
 {
-    PyObject* python_points = NULL;
-    PyObject* python_point = NULL;
-    PyObject* python_coord = NULL;
-    double c_coord = 0;
-    int i, j = 0;
+    int status = -1;
+    PyObject* value = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
+    PyObject* points = NULL; /* This will later be converted to a matrix */
+    int n, d, k, m = 0;
+    unsigned long seed = 0;
+    PMATRIX initial = NULL;
+    PMATRIX updated_h = NULL;
+
+    /* Python -> C */
+    /* Parse the Python arguments into the appropriate data types */
+    if (!PyArg_ParseTuple(args, "Oiiiik", &points, &n, &d, &k, &m, &seed)) 
+    {
+        return NULL;
+    }
 
-    python_points = PyList_New(matrix->rows); /* Creating a python list of length rows */
-    for (i = 0; i < matrix->rows; i++)
+    /* Retrieve points: from python to c matrix of type PMATRIX */
+    status = retrieve_points(points, n, d, &view, &initial);
+    if (status != 0 || k < 1 || m < 1)
     {
-        /* Building single python point with d coords */
-        python_point = PyList_New(matrix->cols); /* Creating a python list of length cols */
-        for (j = 0; j < matrix->cols; j++)
-        {
-            c_coord = matrix->coords[i][j]; /* Retrieving value to put into python coords */
-            python_coord = Py_BuildValue("d", c_coord); /* Converting it to a python double */
-            PyList_SetItem(python_point, j, python_coord); /* Setting point[i] = coord */
-        }
-        PyList_SetItem(python_points, i, python_point); /* Setting points[i] = point */
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* X -> H_final, with W approximated from m landmarks */
+    Py_BEGIN_ALLOW_THREADS
+    status = symnmf_fit_nystrom(initial, k, m, seed, &updated_h);
+    Py_END_ALLOW_THREADS
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* C -> Python: This builds the answer back into a python object */
+    value = build_points(&updated_h);
+
+lblCleanup:
+    free_matrix(initial);
+    free_matrix(updated_h);
+    release_points(&view); /* after the matrix that borrows it */
+    return value;
+}
+
+static PyObject* nystrom_error_wrapper(PyObject* self, PyObject* args)
+{
+    int status = -1;
+    PyObject* value = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
+    PyObject* points = NULL; /* This will later be converted to a matrix */
+    int n, d, m = 0;
+    unsigned long seed = 0;
+    double error = 0;
+    PMATRIX initial = NULL;
+
+    /* Python -> C */
+    /* Parse the Python arguments into the appropriate data types */
+    if (!PyArg_ParseTuple(args, "Oiiik", &points, &n, &d, &m, &seed)) 
+    {
+        return NULL;
+    }
+
+    /* Retrieve points: from python to c matrix of type PMATRIX */
+    status = retrieve_points(points, n, d, &view, &initial);
+    if (status != 0 || m < 1)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    status = nystrom_error(initial, m, seed, &error);
+    Py_END_ALLOW_THREADS
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
     }
-    return python_points;
+
+    /* C -> Python */
+    value = PyFloat_FromDouble(error);
+
+lblCleanup:
+    free_matrix(initial);
+    release_points(&view); /* after the matrix that borrows it */
+    return value;
+}
+
+static PyObject* fit_batch_wrapper(PyObject* self, PyObject* args)
+{
+    int status = -1;
+    PyObject* value = NULL;
+    PyObject* jobs = NULL; /* a list of (X, n, d, k) */
+    PyObject* points = NULL;
+    PyObject* result = NULL;
+    int count, j = 0;
+    int n, d = 0;
+    int workers = 0;
+    unsigned long seed = 0;
+    Py_buffer* views = NULL; /* the buffers the input matrices may borrow */
+    int* ks = NULL;
+    PMATRIX* initials = NULL;
+    PMATRIX* hs = NULL;
+
+    /* Python -> C */
+    /* Parse the Python arguments into the appropriate data types */
+    if (!PyArg_ParseTuple(args, "O!|ki", &PyList_Type, &jobs, &seed, &workers)) 
+    {
+        return NULL;
+    }
+    count = (int)PyList_Size(jobs);
+
+    views = (Py_buffer*)PyMem_Calloc((size_t)count + 1, sizeof(Py_buffer));
+    ks = (int*)HEAPALLOCZ(ks, (size_t)count + 1);
+    initials = (PMATRIX*)HEAPALLOCZ(initials, (size_t)count + 1);
+    hs = (PMATRIX*)HEAPALLOCZ(hs, (size_t)count + 1);
+    if (views == NULL || ks == NULL || initials == NULL || hs == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* All the inputs are retrieved while holding the GIL */
+    for (j = 0; j < count; j++)
+    {
+        if (!PyArg_ParseTuple(PyList_GetItem(jobs, j), "Oiii", &points, &n, &d, &ks[j]))
+            goto lblCleanup;
+
+        status = retrieve_points(points, n, d, &views[j], &initials[j]);
+        if (status != 0 || ks[j] < 1)
+        {
+            printf("An Error Has Occurred\n");
+            goto lblCleanup;
+        }
+    }
+
+    /* The jobs run on the C side, on a team of workers */
+    Py_BEGIN_ALLOW_THREADS
+    (void)symnmf_fit_batch(initials, ks, count, seed, workers, hs);
+    Py_END_ALLOW_THREADS
+
+    /* C -> Python: a list of the final H of every job, None for a job that failed */
+    value = PyList_New(count);
+    for (j = 0; value != NULL && j < count; j++)
+    {
+        if (hs[j] != NULL)
+            result = build_points(&hs[j]);
+        else
+        {
+            result = Py_None;
+            Py_INCREF(result);
+        }
+        PyList_SetItem(value, j, result);
+    }
+
+lblCleanup:
+    for (j = 0; j < count; j++)
+    {
+        if (initials != NULL)
+            free_matrix(initials[j]);
+        if (hs != NULL)
+            free_matrix(hs[j]);
+        if (views != NULL)
+            release_points(&views[j]); /* after the matrix that borrows it */
+    }
+    PyMem_Free(views);
+    HEAPFREE(ks);
+    HEAPFREE(initials);
+    HEAPFREE(hs);
+    return value;
+}
+
+static PyObject* fit_restarts_wrapper(PyObject* self, PyObject* args)
+{
+    int status = -1;
+    PyObject* value = NULL;
+    PyObject* python_h = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
+    PyObject* points = NULL;
+    PyObject* seed_list = NULL;
+    int n, d, k = 0;
+    int count, r = 0;
+    int workers = 0;
+    int best = 0;
+    unsigned long* seeds = NULL;
+    SOLVER_REPORT report = { 0 };
+    PMATRIX initial = NULL;
+    PMATRIX updated_h = NULL;
+
+    /* Python -> C */
+    /* Parse the Python arguments into the appropriate data types */
+    if (!PyArg_ParseTuple(args, "OiiiO!|i", &points, &n, &d, &k, &PyList_Type, &seed_list, &workers)) 
+    {
+        return NULL;
+    }
+    count = (int)PyList_Size(seed_list);
+
+    seeds = (unsigned long*)HEAPALLOCZ(seeds, (size_t)count + 1);
+    if (seeds == NULL || count < 1 || k < 1)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+    for (r = 0; r < count; r++)
+    {
+        seeds[r] = PyLong_AsUnsignedLong(PyList_GetItem(seed_list, r));
+        if (PyErr_Occurred())
+            goto lblCleanup;
+    }
+
+    /* Retrieve points: from python to c matrix of type PMATRIX */
+    status = retrieve_points(points, n, d, &view, &initial);
+    if (status == 1)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    status = symnmf_fit_restarts(initial, k, seeds, count, workers, &updated_h, &best, &report);
+    Py_END_ALLOW_THREADS
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* C -> Python: the best H and its report, with the seed it came from */
+    python_h = build_points(&updated_h);
+    if (python_h != NULL)
+        value = Py_BuildValue("(O{s:i,s:O,s:d,s:d,s:k})", python_h,
+            "iterations", report.iterations, "converged", report.converged ? Py_True : Py_False,
+            "seconds", report.seconds, "residual", report.residual, "seed", seeds[best]);
+    Py_XDECREF(python_h);
+
+lblCleanup:
+    free_matrix(initial);
+    free_matrix(updated_h);
+    release_points(&view); /* after the matrix that borrows it */
+    HEAPFREE(seeds);
+    return value;
+}
+
+static PyObject* sweep_wrapper(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* keywords[] = { "X", "n", "d", "k_min", "k_max", "seed", "cold_starts", NULL };
+    int status = -1;
+    PyObject* value = NULL;
+    PyObject* result = NULL;
+    PyObject* python_h = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
+    PyObject* points = NULL;
+    int n, d = 0;
+    int k_min, k_max, count, j = 0;
+    unsigned long seed = 0;
+    int cold_starts = 0; /* initialized to False */
+    PMATRIX initial = NULL;
+    PMATRIX* hs = NULL;
+    PSWEEP_RESULT results = NULL;
+
+    /* Python -> C */
+    /* Parse the Python arguments into the appropriate data types */
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oiiii|kp", keywords, &points, &n, &d, &k_min, &k_max, &seed,
+        &cold_starts))
+    {
+        return NULL;
+    }
+    count = (k_max >= k_min) ? k_max - k_min + 1 : 0;
+
+    hs = (PMATRIX*)HEAPALLOCZ(hs, (size_t)count + 1);
+    results = (PSWEEP_RESULT)HEAPALLOCZ(results, (size_t)count + 1);
+    if (hs == NULL || results == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* Retrieve points: from python to c matrix of type PMATRIX */
+    status = retrieve_points(points, n, d, &view, &initial);
+    if (status == 1)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    status = symnmf_sweep(initial, k_min, k_max, seed, cold_starts, hs, results);
+    Py_END_ALLOW_THREADS
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* C -> Python: a list of (H, report) per k, the report with the k and its score */
+    value = PyList_New(count);
+    for (j = 0; value != NULL && j < count; j++)
+    {
+        python_h = build_points(&hs[j]);
+        result = (python_h == NULL) ? NULL : Py_BuildValue("(O{s:i,s:O,s:i,s:O,s:d,s:d,s:d})", python_h,
+            "k", results[j].k, "warm_started", results[j].warm_started ? Py_True : Py_False, "iterations", results[j].report.iterations,
+            "converged", results[j].report.converged ? Py_True : Py_False, "seconds", results[j].report.seconds,
+            "residual", results[j].report.residual, "score", results[j].score);
+        Py_XDECREF(python_h);
+        if (result == NULL)
+        {
+            Py_CLEAR(value);
+            break;
+        }
+        PyList_SetItem(value, j, result);
+    }
+
+lblCleanup:
+    for (j = 0; hs != NULL && j < count; j++)
+        free_matrix(hs[j]);
+    free_matrix(initial);
+    release_points(&view); /* after the matrix that borrows it */
+    HEAPFREE(hs);
+    HEAPFREE(results);
+    return value;
+}
+
+static PyObject* assign_wrapper(PyObject* self, PyObject* args)
+{
+    int status = -1;
+    PyObject* value = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
+    PyObject* h_points = NULL;
+    int n, k, i = 0;
+    int* labels = NULL;
+    PMATRIX h = NULL;
+
+    /* Python -> C */
+    /* Parse the Python arguments into the appropriate data types */
+    if (!PyArg_ParseTuple(args, "Oii", &h_points, &n, &k)) 
+    {
+        return NULL;
+    }
+
+    labels = (int*)HEAPALLOCZ(labels, (size_t)n + 1);
+    if (labels == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    status = retrieve_points(h_points, n, k, &view, &h);
+    if (status == 1)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    (void)assign_clusters(h, labels);
+    Py_END_ALLOW_THREADS
+
+    /* C -> Python: the list of labels */
+    value = PyList_New(n);
+    for (i = 0; value != NULL && i < n; i++)
+        PyList_SetItem(value, i, PyLong_FromLong(labels[i]));
+
+lblCleanup:
+    free_matrix(h);
+    release_points(&view); /* after the matrix that borrows it */
+    HEAPFREE(labels);
+    return value;
+}
+
+static PyObject* silhouette_wrapper(PyObject* self, PyObject* args)
+{
+    int status = -1;
+    PyObject* value = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
+    PyObject* points = NULL;
+    PyObject* label_list = NULL;
+    PyObject* sequence = NULL;
+    int n, d, i = 0;
+    int k = 0;
+    int* labels = NULL;
+    double score = 0;
+    PMATRIX initial = NULL;
+
+    /* Python -> C */
+    /* Parse the Python arguments into the appropriate data types */
+    if (!PyArg_ParseTuple(args, "OiiO", &points, &n, &d, &label_list)) 
+    {
+        return NULL;
+    }
+
+    /* The labels: any sequence of n ints (a list, or a numpy array) */
+    sequence = PySequence_Fast(label_list, "labels must be a sequence");
+    if (sequence == NULL)
+        return NULL;
+    labels = (int*)HEAPALLOCZ(labels, (size_t)n + 1);
+    if (labels == NULL || PySequence_Fast_GET_SIZE(sequence) != n)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+    for (i = 0; i < n; i++)
+    {
+        labels[i] = (int)PyLong_AsLong(PySequence_Fast_GET_ITEM(sequence, i));
+        if (PyErr_Occurred())
+            goto lblCleanup;
+        if (labels[i] >= k)
+            k = labels[i] + 1;
+    }
+
+    /* Retrieve points: from python to c matrix of type PMATRIX */
+    status = retrieve_points(points, n, d, &view, &initial);
+    if (status == 1)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    status = silhouette(initial, labels, k, &score);
+    Py_END_ALLOW_THREADS
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* C -> Python */
+    value = Py_BuildValue("d", score);
+
+lblCleanup:
+    free_matrix(initial);
+    release_points(&view); /* after the matrix that borrows it */
+    Py_DECREF(sequence);
+    HEAPFREE(labels);
+    return value;
+}
+
+static PyObject* kmeans_wrapper(PyObject* self, PyObject* args)
+{
+    static const char* init_names[KMEANS_INIT_COUNT] = { "first", "++" };
+    int status = -1;
+    PyObject* value = NULL;
+    PyObject* label_list = NULL;
+    PyObject* python_centroids = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
+    PyObject* points = NULL;
+    const char* init_name = "first";
+    int n, d, k, i = 0;
+    int init = 0;
+    int iterations = 0;
+    int* labels = NULL;
+    unsigned long seed = 0;
+    PMATRIX initial = NULL;
+    PMATRIX centroids = NULL;
+
+    /* Python -> C */
+    /* Parse the Python arguments into the appropriate data types */
+    if (!PyArg_ParseTuple(args, "Oiii|sk", &points, &n, &d, &k, &init_name, &seed)) 
+    {
+        return NULL;
+    }
+    for (init = 0; init < KMEANS_INIT_COUNT; init++)
+        if (strcmp(init_name, init_names[init]) == 0)
+            break;
+
+    labels = (int*)HEAPALLOCZ(labels, (size_t)n + 1);
+    if (init == KMEANS_INIT_COUNT || labels == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* Retrieve points: from python to c matrix of type PMATRIX */
+    status = retrieve_points(points, n, d, &view, &initial);
+    if (status == 1)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    status = kmeans(initial, k, (KMEANS_INIT)init, seed, labels, &centroids, &iterations);
+    Py_END_ALLOW_THREADS
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* C -> Python: the list of labels, the centroids and the iterations */
+    label_list = PyList_New(n);
+    for (i = 0; label_list != NULL && i < n; i++)
+        PyList_SetItem(label_list, i, PyLong_FromLong(labels[i]));
+    python_centroids = build_points(&centroids);
+    if (label_list != NULL && python_centroids != NULL)
+        value = Py_BuildValue("(OOi)", label_list, python_centroids, iterations);
+    Py_XDECREF(label_list);
+    Py_XDECREF(python_centroids);
+
+lblCleanup:
+    free_matrix(initial);
+    free_matrix(centroids);
+    release_points(&view); /* after the matrix that borrows it */
+    HEAPFREE(labels);
+    return value;
+}
+
+static PyObject* knn_norm_wrapper(PyObject* self, PyObject* args)
+{
+    int status = -1;
+    PyObject* value = NULL;
+    Py_buffer view = { 0 }; /* the buffer the input matrix may borrow */
+    PyObject* points = NULL; /* This will later be converted to a matrix */
+    int n, d, knn = 0;
+    double threshold = 0;
+    double* degrees = NULL;
+    PMATRIX initial = NULL;
+    PCSR_MATRIX sim = NULL;
+
+    /* Python -> C */
+    /* Parse the Python arguments into the appropriate data types */
+    if (!PyArg_ParseTuple(args, "Oiiid", &points, &n, &d, &knn, &threshold)) 
+    {
+        return NULL;
+    }
+
+    /* Retrieve points: from python to c matrix of type PMATRIX */
+    status = retrieve_points(points, n, d, &view, &initial);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* sym and ddg phases: the knn graph A and its degrees */
+    Py_BEGIN_ALLOW_THREADS
+    status = sym_knn(initial, knn, threshold, &sim, &degrees);
+    Py_END_ALLOW_THREADS
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* norm phase: getting W from the degrees and A, in place */
+    Py_BEGIN_ALLOW_THREADS
+    (void)csr_norm_in_place(sim, degrees);
+    Py_END_ALLOW_THREADS
+
+    /* C -> Python: This builds the answer back into a python object */
+    value = build_csr(sim);
+
+lblCleanup:
+    free_matrix(initial);
+    free_csr(sim);
+    HEAPFREE(degrees);
+    release_points(&view); /* after the matrix that borrows it */
+    return value;
+}
+
+static PyObject* symnmf_knn_wrapper(PyObject* self, PyObject* args)
+{
+    int status = -1;
+    PyObject* value = NULL;
+    PyObject* indptr = NULL;
+    PyObject* indices = NULL;
+    PyObject* data = NULL;
+    PyObject* h_points = NULL; 
+    int n, k = 0;
+    PCSR_MATRIX normalized = NULL;
+    PMATRIX initial_h = NULL;
+    PMATRIX updated_h = NULL;
+
+    /* Python -> C */
+    /* Parse the Python arguments into the appropriate data types */
+    if (!PyArg_ParseTuple(args, "OOOOii", &indptr, &indices, &data, &h_points, &n, &k)) 
+    {
+        return NULL;
+    }
+
+    /* Retrieve W (CSR) and H */
+    status = retrieve_csr(indptr, indices, data, n, &normalized);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    status = retrieve_points(h_points, n, k, NULL, &initial_h); /* a copy, the solver updates it in place */
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    status = symnmf_sparse(initial_h, normalized, &updated_h);
+    Py_END_ALLOW_THREADS
+    initial_h = NULL;
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* C -> Python: This builds the answer back into a python object */
+    value = build_points(&updated_h);
+
+lblCleanup:
+    free_csr(normalized);
+    free_matrix(initial_h);
+    free_matrix(updated_h);
+    return value;
+}
+
+static PyObject* load_wrapper(PyObject* self, PyObject* args)
+{
+    int status = -1;
+    PyObject* value = NULL;
+    char* file_name = NULL;
+    PMATRIX initial = NULL;
+
+    /* Python -> C */
+    if (!PyArg_ParseTuple(args, "s", &file_name)) 
+    {
+        return NULL;
+    }
+
+    /* Parse (or map) the file with the C reader */
+    Py_BEGIN_ALLOW_THREADS
+    status = load_matrix(file_name, &initial);
+    Py_END_ALLOW_THREADS
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* C -> Python: This builds the answer back into a python object */
+    value = build_points(&initial);
+
+lblCleanup:
+    free_matrix(initial);
+    return value;
+}
+
+static PyObject* set_num_threads_wrapper(PyObject* self, PyObject* args)
+{
+    int threads = 0;
+
+    /* Python -> C */
+    if (!PyArg_ParseTuple(args, "i", &threads)) 
+    {
+        return NULL;
+    }
+
+    (void)set_thread_count(threads);
+    Py_RETURN_NONE;
+}
+
+static PyObject* get_num_threads_wrapper(PyObject* self, PyObject* args)
+{
+    /* C -> Python */
+    return Py_BuildValue("i", get_thread_count());
+}
+
+/* MATRIX TYPE: owns a C matrix and exports it through the buffer protocol, so np.asarray(m) is a view, not a copy */
+static int matrix_getbuffer(PyObject* self, Py_buffer* view, int flags)
+{
+    MATRIX_OBJECT* object = (MATRIX_OBJECT*)self;
+
+    /* build_points compacted the rows, so the buffer is C-contiguous and any request can be served */
+    view->buf = object->matrix->data;
+    view->obj = self;
+    Py_INCREF(self);
+    view->len = object->shape[0] * object->shape[1] * (Py_ssize_t)sizeof(REAL);
+    view->readonly = 0;
+    view->itemsize = sizeof(REAL);
+    view->format = ((flags & PyBUF_FORMAT) == PyBUF_FORMAT) ? REAL_FORMAT : NULL;
+    view->ndim = 2;
+    view->shape = object->shape;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? object->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static void matrix_dealloc(PyObject* self)
+{
+    PyTypeObject* type = Py_TYPE(self);
+
+    free_matrix(((MATRIX_OBJECT*)self)->matrix);
+    PyObject_Free(self);
+    Py_DECREF(type);
+}
+
+static PyObject* matrix_shape(PyObject* self, void* closure)
+{
+    MATRIX_OBJECT* object = (MATRIX_OBJECT*)self;
+
+    (void)closure;
+    return Py_BuildValue("(nn)", object->shape[0], object->shape[1]);
+}
+
+static PyGetSetDef matrix_getset[] = {
+    {"shape", (getter)matrix_shape, NULL, PyDoc_STR("(rows, cols)"), NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot matrix_slots[] = {
+    {Py_bf_getbuffer, (void*)matrix_getbuffer},
+    {Py_tp_dealloc, (void*)matrix_dealloc},
+    {Py_tp_getset, (void*)matrix_getset},
+    {Py_tp_doc, (void*)PyDoc_STR("A matrix (of symnmf_capi.dtype) computed by symnmf_capi, use np.asarray(m) for a view of it")},
+    {0, NULL}
+};
+
+static PyType_Spec matrix_spec = {
+    "symnmf_capi.Matrix",
+    sizeof(MATRIX_OBJECT),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    matrix_slots
+};
+
+/* STREAM TYPE: the state of an incremental fit, points are appended in batches and every fit resumes from the last H */
+static PyObject* stream_new(PyTypeObject* type, PyObject* args, PyObject* kwargs)
+{
+    static char* keywords[] = { "d", "k", "seed", NULL };
+    int d, k = 0;
+    unsigned long seed = 0;
+    STREAM_OBJECT* object = NULL;
+
+    /* Python -> C */
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|k", keywords, &d, &k, &seed))
+        return NULL;
+    if (d < 1 || k < 1)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+
+    object = (STREAM_OBJECT*)type->tp_alloc(type, 0);
+    if (object == NULL)
+        return NULL;
+    if (create_stream(d, k, seed, &object->stream) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        Py_DECREF(object);
+        return NULL;
+    }
+    return (PyObject*)object;
+}
+
+static void stream_dealloc(PyObject* self)
+{
+    PyTypeObject* type = Py_TYPE(self);
+
+    free_stream(((STREAM_OBJECT*)self)->stream);
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+static PyObject* stream_append_method(PyObject* self, PyObject* args)
+{
+    int status = -1;
+    PyObject* value = NULL;
+    Py_buffer view = { 0 }; /* the buffer the new points may borrow */
+    PyObject* points = NULL;
+    int m = 0;
+    PMATRIX initial = NULL;
+    STREAM_OBJECT* object = (STREAM_OBJECT*)self;
+
+    /* Python -> C */
+    if (!PyArg_ParseTuple(args, "Oi", &points, &m))
+        return NULL;
+    if (object->busy)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+
+    status = retrieve_points(points, m, object->stream->d, &view, &initial);
+    if (status == 1)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    object->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
+    status = stream_append(object->stream, initial);
+    Py_END_ALLOW_THREADS
+    object->busy = 0;
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* C -> Python: the number of points so far */
+    value = Py_BuildValue("i", object->stream->n);
+
+lblCleanup:
+    free_matrix(initial);
+    release_points(&view); /* after the matrix that borrows it */
+    return value;
+}
+
+static PyObject* stream_fit_method(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* keywords[] = { "solver", "target_residual", "beta", "epsilon", "max_iter", "check_interval", "criterion", NULL };
+    int status = -1;
+    int i = 0;
+    PyObject* value = NULL;
+    PyObject* python_h = NULL;
+    const char* solver_name = "mu";
+    const char* criterion_name = "delta";
+    SYMNMF_PARAMS params;
+    SOLVER_REPORT report = { 0 };
+    PMATRIX h = NULL;
+    STREAM_OBJECT* object = (STREAM_OBJECT*)self;
+
+    /* Python -> C */
+    (void)default_params(&params);
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|sdddiis", keywords, &solver_name, &params.target_residual,
+        &params.beta, &params.epsilon, &params.max_iter, &params.check_interval, &criterion_name))
+    {
+        return NULL;
+    }
+    if (params_from_names(solver_name, criterion_name, &params) != 0 || object->busy)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+
+    object->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
+    status = stream_fit(object->stream, &params, &report);
+    Py_END_ALLOW_THREADS
+    object->busy = 0;
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* C -> Python: a copy of the H the stream keeps, and the report as a dict */
+    status = create_matrix(object->stream->h->rows, object->stream->k, &h);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+    for (i = 0; i < h->rows; i++)
+        (void)memcpy(MAT_ROW(h, i), MAT_ROW(object->stream->h, i), (size_t)h->cols * sizeof(REAL));
+
+    python_h = build_points(&h);
+    if (python_h != NULL)
+        value = Py_BuildValue("(O{s:i,s:O,s:d,s:d})", python_h,
+            "iterations", report.iterations, "converged", report.converged ? Py_True : Py_False,
+            "seconds", report.seconds, "residual", report.residual);
+    Py_XDECREF(python_h);
+
+lblCleanup:
+    free_matrix(h);
+    return value;
+}
+
+static PyObject* stream_n(PyObject* self, void* closure)
+{
+    (void)closure;
+    return Py_BuildValue("i", ((STREAM_OBJECT*)self)->stream->n);
+}
+
+static PyMethodDef stream_methods[] = {
+    {"append", (PyCFunction)stream_append_method, METH_VARARGS, PyDoc_STR("append(X, m): adds m points (of dimension d) to the similarity and degree state, in O(m*n*d). Returns the number of points so far")}, /* stream_append() */
+    {"fit", (PyCFunction)stream_fit_method, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("fit(solver='mu', target_residual=0, beta=0.5, epsilon=1e-4, max_iter=300, check_interval=1, criterion='delta'): the iterations of solve over all the points so far, from the H of the last fit (the first one starts like fit). Returns (H, report)")}, /* stream_fit() */
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef stream_getset[] = {
+    {"n", (getter)stream_n, NULL, PyDoc_STR("points appended so far"), NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot stream_slots[] = {
+    {Py_tp_new, (void*)stream_new},
+    {Py_tp_dealloc, (void*)stream_dealloc},
+    {Py_tp_methods, (void*)stream_methods},
+    {Py_tp_getset, (void*)stream_getset},
+    {Py_tp_doc, (void*)PyDoc_STR("Stream(d, k, seed=0): incremental symnmf for points that arrive in batches, one call at a time per stream")},
+    {0, NULL}
+};
+
+static PyType_Spec stream_spec = {
+    "symnmf_capi.Stream",
+    sizeof(STREAM_OBJECT),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    stream_slots
+};
+
+static PyMethodDef symnmfMethods[] = {
+    {"sym", (PyCFunction)sym_wrapper, METH_VARARGS, PyDoc_STR("sym: constructing the similarity matrix")}, /* sym() */
+    {"ddg", (PyCFunction)ddg_wrapper, METH_VARARGS, PyDoc_STR("ddg: constructing the diagonal degree matrix")}, /* ddg() */
+    {"norm", (PyCFunction)norm_wrapper, METH_VARARGS, PyDoc_STR("norm: constructing the normalized matrix")}, /* norm() */
+    {"symnmf", (PyCFunction)symnmf_wrapper, METH_VARARGS, PyDoc_STR("symnmf: getting the final H")}, /* symnmf() */
+    {"mat_mult", (PyCFunction)mat_mult_wrapper, METH_VARARGS, PyDoc_STR("mat_mult(A, B, n, k, m): the product of A (nXk) and B (kXm) by the blocked matrix multiplication engine")}, /* mat_mult() */
+    {"solve", (PyCFunction)solve_wrapper, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("solve(W, H, n, k, solver, target_residual=0, beta=0.5, epsilon=1e-4, max_iter=300, check_interval=1, criterion='delta'): symnmf with the solver 'mu', 'momentum', 'hals' or 'anls', stopping when the criterion ('delta' on ||H(i+1) - H(i)||^2, or 'objective' on the relative change of ||W - H*H^T||_F^2) checked every check_interval iterations is below epsilon, or below the target ||W - H*H^T||_F^2. Returns (H, report) with the iterations, wall time, final residual and whether it converged")}, /* symnmf_solve_with() */
+    {"fit", (PyCFunction)fit_wrapper, METH_VARARGS, PyDoc_STR("fit(X, n, d, k, seed, return_w=False): the final H (and W) straight from the points, H_0 drawn like np.random.seed(seed) with numpy")}, /* symnmf_fit() */
+    {"fit_out_of_core", (PyCFunction)fit_out_of_core_wrapper, METH_VARARGS, PyDoc_STR("fit_out_of_core(X, n, d, k, seed, scratch_dir): fit, with W streamed from a scratch file under scratch_dir instead of kept in memory")}, /* symnmf_fit_out_of_core() */
+    {"fit_nystrom", (PyCFunction)fit_nystrom_wrapper, METH_VARARGS, PyDoc_STR("fit_nystrom(X, n, d, k, m, seed): fit, with W approximated from m landmarks (drawn with seed) in O(n*m) memory")}, /* symnmf_fit_nystrom() */
+    {"nystrom_error", (PyCFunction)nystrom_error_wrapper, METH_VARARGS, PyDoc_STR("nystrom_error(X, n, d, m, seed): relative Frobenius error of the W of fit_nystrom against the exact W (forms it, small n only)")}, /* nystrom_error() */
+    {"fit_batch", (PyCFunction)fit_batch_wrapper, METH_VARARGS, PyDoc_STR("fit_batch([(X, n, d, k), ...], seed=0, workers=0): fit of many independent jobs, run concurrently on C threads. Returns the list of the final H")}, /* symnmf_fit_batch() */
+    {"fit_restarts", (PyCFunction)fit_restarts_wrapper, METH_VARARGS, PyDoc_STR("fit_restarts(X, n, d, k, seeds, workers=0): fit from every seed of the list, run concurrently on C threads that share W. Returns (H, report) for the lowest final ||W - H*H^T||_F^2, the report also tells its seed")}, /* symnmf_fit_restarts() */
+    {"sweep", (PyCFunction)sweep_wrapper, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("sweep(X, n, d, k_min, k_max, seed=0, cold_starts=False): W once, then the final H for every k in k_min..k_max, each k solved from the H of the k before with its largest cluster split (warm), and with cold_starts also from a cold start, keeping the lower residual. Returns a list of (H, report), the report with k, whether the kept H is the warm one, its iterations, wall time, residual and the euclidean silhouette score of its argmax clusters")}, /* symnmf_sweep() */
+    {"assign", (PyCFunction)assign_wrapper, METH_VARARGS, PyDoc_STR("assign(H, n, k): the cluster of every point, the argmax of its row of H (the first one on ties), as a list")}, /* assign_clusters() */
+    {"silhouette", (PyCFunction)silhouette_wrapper, METH_VARARGS, PyDoc_STR("silhouette(X, n, d, labels): the mean euclidean silhouette score of the labels (ints from 0, at least 2 and at most n-1 distinct), like sklearn's, computed in tiles without the nXn distance matrix")}, /* silhouette() */
+    {"kmeans", (PyCFunction)kmeans_wrapper, METH_VARARGS, PyDoc_STR("kmeans(X, n, d, k, init='first', seed=0): the K-means of the analysis (init 'first': the first k points are the initial centroids) or with k-means++ initial centroids drawn by the seed (init '++'), pruned by Hamerly's bounds. Returns (labels list, centroids kXd, iterations)")}, /* kmeans() */
+    {"knn_norm", (PyCFunction)knn_norm_wrapper, METH_VARARGS, PyDoc_STR("knn_norm: constructing the normalized matrix of the knn graph, as (indptr, indices, data)")}, /* sym_knn(), csr_norm_in_place() */
+    {"symnmf_knn", (PyCFunction)symnmf_knn_wrapper, METH_VARARGS, PyDoc_STR("symnmf_knn: getting the final H for a normalized knn graph")}, /* symnmf_sparse() */
+    {"load", (PyCFunction)load_wrapper, METH_VARARGS, PyDoc_STR("load: reading the points of a CSV (or binary matrix) file")}, /* load_matrix() */
+    {"set_num_threads", (PyCFunction)set_num_threads_wrapper, METH_VARARGS, PyDoc_STR("set_num_threads: number of threads for the following calls, 0 for one per core")}, /* set_thread_count() */
+    {"get_num_threads", (PyCFunction)get_num_threads_wrapper, METH_NOARGS, PyDoc_STR("get_num_threads: number of threads the following calls will use")}, /* get_thread_count() */
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef symnmfmodule =
+{
+    PyModuleDef_HEAD_INIT, 
+    "symnmf_capi", /* name of module */
+    NULL, /* module documentation */
+    -1, /* size of per-interpreter state of the module, or -1 if the module keeps state in global variables. */
+    symnmfMethods /* the PyMethodDef array from before containing the methods of the extension */
+};
+
+PyMODINIT_FUNC PyInit_symnmf_capi(void)
+{
+    PyObject *m;
+    m = PyModule_Create(&symnmfmodule);
+    if (!m)
+        return NULL;
+
+    /* The import runs once, under the GIL, before any call can start C threads */
+    (void)init_sim_kernel();
+
+    matrix_type = PyType_FromSpec(&matrix_spec);
+    if (matrix_type == NULL || PyModule_AddObject(m, "Matrix", matrix_type) != 0)
+    {
+        Py_DECREF(m);
+        return NULL;
+    }
+    Py_INCREF(matrix_type); /* the module's reference was stolen, this one is kept for build_points */
+
+    stream_type = PyType_FromSpec(&stream_spec);
+    if (stream_type == NULL || PyModule_AddObject(m, "Stream", stream_type) != 0)
+    {
+        Py_DECREF(m);
+        return NULL;
+    }
+
+    /* The element type of the matrices, as a numpy dtype name */
+    if (PyModule_AddStringConstant(m, "dtype", (sizeof(REAL) == sizeof(float)) ? "float32" : "float64") != 0)
+    {
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
+
+static int retrieve_buffer(PyObject* points, int n, int d, Py_buffer* view, PMATRIX* pmatrix)
+{
+    /* Takes the matrix from a buffer of the element type (float64, or float32 in a single precision build), rows may be padded but each row must be contiguous.
+    With a view the matrix borrows the buffer, without one the buffer is copied */
+    int status = -1;
+    int i = 0;
+    Py_ssize_t row_stride = 0;
+    Py_buffer local;
+    Py_buffer* used = (view != NULL) ? view : &local;
+    PMATRIX matrix = NULL;
+
+    if (PyObject_GetBuffer(points, used, PyBUF_RECORDS_RO) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+
+    /* Either nXd, or a vector of n points for d = 1. The strides are only read once ndim is known */
+    if (used->itemsize != sizeof(REAL) || used->format == NULL || strcmp(used->format, REAL_FORMAT) != 0 ||
+        used->suboffsets != NULL || ((size_t)used->buf % sizeof(REAL)) != 0 ||
+        !((used->ndim == 2 && used->shape[0] == n && used->shape[1] == d && used->strides[1] == sizeof(REAL)) ||
+          (used->ndim == 1 && used->shape[0] == n && d == 1)))
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    row_stride = used->strides[0];
+    if (n > 1 && (row_stride < (Py_ssize_t)(d * sizeof(REAL)) || row_stride % sizeof(REAL) != 0))
+    {
+        printf("An Error Has Occurred\n");
+        status = 1;
+        goto lblCleanup;
+    }
+    row_stride = (n > 1) ? row_stride / (Py_ssize_t)sizeof(REAL) : d;
+
+    if (view != NULL)
+    {
+        /* Zero-copy: the matrix points into the buffer, which the caller keeps until the matrix is freed */
+        matrix = (PMATRIX)HEAPALLOCZ(matrix, 1);
+        if (matrix == NULL)
+        {
+            printf("An Error Has Occurred\n");
+            status = 1;
+            goto lblCleanup;
+        }
+        matrix->data = (REAL*)used->buf;
+        matrix->rows = n;
+        matrix->cols = d;
+        matrix->stride = (int)row_stride;
+        matrix->borrowed = 1;
+    }
+    else
+    {
+        status = create_matrix(n, d, &matrix);
+        if (status != 0)
+        {
+            printf("An Error Has Occurred\n");
+            goto lblCleanup;
+        }
+        for (i = 0; i < n; i++)
+            (void)memcpy(MAT_ROW(matrix, i), (REAL*)used->buf + (size_t)i * (size_t)row_stride, (size_t)d * sizeof(REAL));
+    }
+
+    /* Transfer ownership */
+    *pmatrix = matrix;
+    matrix = NULL;
+
+    status = 0;
+
+lblCleanup:
+    if (view == NULL)
+        PyBuffer_Release(&local);
+    free_matrix(matrix);
+    return status;
+}
+
+int retrieve_points(PyObject* points, int n, int d, Py_buffer* view, PMATRIX* pmatrix)
+{
+    int status = -1;
+    PMATRIX matrix = NULL;
+    PyObject* point = NULL;
+    PyObject* coord_object = NULL;
+    double coord = 0;
+    int i, j = 0;
+
+    /* The path of a binary matrix file can be given instead of the points: the file is mapped, without a copy */
+    if (PyUnicode_Check(points))
+    {
+        status = map_matrix_file((char*)PyUnicode_AsUTF8(points), &matrix);
+        if (status != 0 || matrix->rows != n || matrix->cols != d)
+        {
+            printf("An Error Has Occurred\n");
+            status = 1;
+            goto lblCleanup;
+        }
+
+        /* Transfer ownership */
+        *pmatrix = matrix;
+        matrix = NULL;
+
+        status = 0;
+        goto lblCleanup;
+    }
+
+    /* numpy arrays (and Matrix objects) are taken through the buffer protocol */
+    if (PyObject_CheckBuffer(points))
+        return retrieve_buffer(points, n, d, view, pmatrix);
+
+    /* create a new empty initial matrix */
+    status = create_matrix(n, d, &matrix);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* fill the matrix with coords */
+    for (i = 0; i < n; i++) 
+    {
+        point = PyList_GetItem(points, i);
+        for (j = 0; j < d; j++) 
+        {
+            coord_object = PyList_GetItem(point, j);
+            coord = PyFloat_AsDouble(coord_object);
+            MAT_AT(matrix, i, j) = coord;
+        }
+    }
+
+    /* Transfer ownership */
+    *pmatrix = matrix;
+    matrix = NULL;
+
+    status = 0;
+
+lblCleanup:
+    free_matrix(matrix);
+    return status;
+}
+
+void release_points(Py_buffer* view)
+{
+    if (view->obj != NULL)
+        PyBuffer_Release(view);
+}
+
+PyObject* build_points(PMATRIX* pmatrix)
+{
+    int i = 0;
+    MATRIX_OBJECT* object = NULL;
+    PMATRIX matrix = *pmatrix;
+
+    object = PyObject_New(MATRIX_OBJECT, (PyTypeObject*)matrix_type);
+    if (object == NULL)
+        return NULL;
+
+    /* The padding of the rows is dropped in place (row i moves down from i * stride to i * cols), so python gets a
+    C-contiguous array that np.ascontiguousarray and tofile use as is. It is one pass over the result */
+    for (i = 1; i < matrix->rows && matrix->stride != matrix->cols; i++)
+        (void)memmove(matrix->data + (size_t)i * (size_t)matrix->cols, MAT_ROW(matrix, i), (size_t)matrix->cols * sizeof(REAL));
+    matrix->stride = matrix->cols;
+    object->shape[0] = matrix->rows;
+    object->shape[1] = matrix->cols;
+    object->strides[0] = (Py_ssize_t)matrix->stride * (Py_ssize_t)sizeof(REAL);
+    object->strides[1] = sizeof(REAL);
+
+    /* Transfer ownership */
+    object->matrix = matrix;
+    *pmatrix = NULL;
+
+    return (PyObject*)object;
+}
+
+int retrieve_csr(PyObject* indptr, PyObject* indices, PyObject* data, int n, PCSR_MATRIX* pcsr)
+{
+    /* The lists are checked before anything is built from them, the kernels index by them unchecked.
+    A failure leaves a ValueError set */
+    int status = -1;
+    int i = 0;
+    long column = 0;
+    size_t e, nnz = 0;
+    Py_ssize_t offset = 0;
+    double value = 0;
+    PCSR_MATRIX csr = NULL;
+
+    if (!PyList_Check(indptr) || !PyList_Check(indices) || !PyList_Check(data))
+    {
+        PyErr_SetString(PyExc_ValueError, "indptr, indices and data must be lists");
+        status = 1;
+        goto lblCleanup;
+    }
+    if (n < 1 || PyList_Size(indptr) != (Py_ssize_t)n + 1 || PyList_Size(indices) != PyList_Size(data))
+    {
+        PyErr_SetString(PyExc_ValueError, "indptr must have n+1 entries, and indices as many as data");
+        status = 1;
+        goto lblCleanup;
+    }
+    nnz = (size_t)PyList_Size(data);
+
+    /* create a new empty CSR matrix */
+    status = create_csr(n, n, nnz, &csr);
+    if (status != 0)
+    {
+        printf("An Error Has Occurred\n");
+        goto lblCleanup;
+    }
+
+    /* fill the rows: from 0, non-decreasing, up to the number of entries */
+    for (i = 0; i <= n; i++)
+    {
+        offset = PyLong_AsSsize_t(PyList_GET_ITEM(indptr, i));
+        if (offset == -1 && PyErr_Occurred())
+        {
+            PyErr_SetString(PyExc_ValueError, "indptr and indices must hold ints, and data numbers");
+            status = 1;
+            goto lblCleanup;
+        }
+        if ((i == 0 && offset != 0) || (i > 0 && (size_t)offset < csr->row_ptr[i - 1]) || (i == n && (size_t)offset != nnz))
+        {
+            PyErr_SetString(PyExc_ValueError, "indptr must start at 0, never decrease and end at len(indices)");
+            status = 1;
+            goto lblCleanup;
+        }
+        csr->row_ptr[i] = (size_t)offset;
+    }
+
+    /* and then the entries, every column in 0..n-1 */
+    for (e = 0; e < nnz; e++)
+    {
+        column = PyLong_AsLong(PyList_GET_ITEM(indices, (Py_ssize_t)e));
+        if (column == -1 && PyErr_Occurred())
+        {
+            PyErr_SetString(PyExc_ValueError, "indptr and indices must hold ints, and data numbers");
+            status = 1;
+            goto lblCleanup;
+        }
+        if (column < 0 || column >= n)
+        {
+            PyErr_SetString(PyExc_ValueError, "every column index must be in 0..n-1");
+            status = 1;
+            goto lblCleanup;
+        }
+        value = PyFloat_AsDouble(PyList_GET_ITEM(data, (Py_ssize_t)e));
+        if (value == -1.0 && PyErr_Occurred())
+        {
+            PyErr_SetString(PyExc_ValueError, "indptr and indices must hold ints, and data numbers");
+            status = 1;
+            goto lblCleanup;
+        }
+        csr->col_idx[e] = (int)column;
+        csr->values[e] = value;
+    }
+    csr->nnz = nnz;
+
+    /* Transfer ownership */
+    *pcsr = csr;
+    csr = NULL;
+
+    status = 0;
+
+lblCleanup:
+    free_csr(csr);
+    return status;
+}
+
+PyObject* build_csr(PCSR_MATRIX csr)
+{
+    PyObject* python_indptr = NULL;
+    PyObject* python_indices = NULL;
+    PyObject* python_data = NULL;
+    int i = 0;
+    size_t e = 0;
+
+    python_indptr = PyList_New(csr->rows + 1);
+    for (i = 0; i <= csr->rows; i++)
+        PyList_SetItem(python_indptr, i, PyLong_FromSize_t(csr->row_ptr[i]));
+
+    python_indices = PyList_New((Py_ssize_t)csr->nnz);
+    python_data = PyList_New((Py_ssize_t)csr->nnz);
+    for (e = 0; e < csr->nnz; e++)
+    {
+        PyList_SetItem(python_indices, (Py_ssize_t)e, PyLong_FromLong(csr->col_idx[e]));
+        PyList_SetItem(python_data, (Py_ssize_t)e, PyFloat_FromDouble(csr->values[e]));
+    }
+
+    /* The tuple steals the references, scipy.sparse.csr_matrix((data, indices, indptr)) takes the same arrays */
+    return Py_BuildValue("(NNN)", python_indptr, python_indices, python_data);
 }
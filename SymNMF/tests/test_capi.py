@@ -0,0 +1,153 @@
+""" Tests of the C extension (make test) """
+import os
+import tempfile
+import unittest
+import numpy as np
+import symnmf_capi
+
+
+def gaussian_blobs(k, per_cluster, d=2, spread=0.3, distance=10.0, seed=0):
+    # k well-separated clusters of per_cluster points each, the centers on a line distance apart
+    rng = np.random.default_rng(seed)
+    centers = np.zeros((k, d))
+    centers[:, 0] = distance * np.arange(k)
+    return np.vstack([c + spread * rng.standard_normal((per_cluster, d)) for c in centers])
+
+
+class MatMultTest(unittest.TestCase):
+    def test_matches_naive_product(self):
+        # around the register tile (4 x 8), a panel of A (128 x 256), and the thin shapes of W*H, k = 1 included
+        rng = np.random.default_rng(0)
+        for n, k, m in [(1, 1, 1), (3, 1, 5), (129, 1, 9), (5, 7, 3), (4, 8, 8), (131, 257, 13), (130, 300, 1),
+                        (257, 513, 17), (33, 256, 8), (128, 255, 7)]:
+            A = rng.uniform(-1, 1, (n, k))
+            B = rng.uniform(-1, 1, (k, m))
+            naive = (A[:, :, None] * B[None, :, :]).sum(axis=1)  # every term, without BLAS
+            product = np.asarray(symnmf_capi.mat_mult(A, B, n, k, m))
+            self.assertEqual(product.shape, (n, m))
+            np.testing.assert_allclose(product, naive, rtol=0, atol=1e-12 * k)
+
+
+class SolveTest(unittest.TestCase):
+    def setUp(self):
+        X = gaussian_blobs(3, 20)
+        self.n, self.k = len(X), 3
+        self.W = np.asarray(symnmf_capi.norm(X, self.n, X.shape[1]))
+        self.H0 = np.random.default_rng(1).uniform(0, 0.5, (self.n, self.k))
+
+    def test_keywords_match_positional(self):
+        positional, _ = symnmf_capi.solve(self.W, self.H0, self.n, self.k, 'mu')
+        named, report = symnmf_capi.solve(H=self.H0, W=self.W, n=self.n, k=self.k, solver='mu')
+        np.testing.assert_array_equal(np.asarray(positional), np.asarray(named))
+        self.assertGreater(report["iterations"], 0)
+
+    def test_mu_matches_symnmf(self):
+        solved, _ = symnmf_capi.solve(self.W, self.H0, self.n, self.k, 'mu')
+        reference = symnmf_capi.symnmf(self.W, self.H0, self.n, self.k)
+        np.testing.assert_array_equal(np.asarray(solved), np.asarray(reference))
+
+
+class LoadTest(unittest.TestCase):
+    # edge cases of the fast path: 15 and 16 digit mantissas, exponents around the exact powers of ten (22)
+    TOKENS = ["0.1", "-0.0", "+7", "123456789012345", "1234567890123456", "0.123456789012345", "0.1234567890123456",
+              "9007199254740993", "1e22", "1e23", "1e-22", "1e-23", "4.35e22", "4.35e-23", "123456789012345e7",
+              "1.5E+10", "-2.5e-5", "000123.4500", ".5", "5.", "1e308", "2.2250738585072014e-308", "3.14159265358979323846"]
+
+    def load(self, text):
+        with tempfile.NamedTemporaryFile("w", suffix=".txt", delete=False, newline="") as f:
+            f.write(text)
+        try:
+            return np.asarray(symnmf_capi.load(f.name))
+        finally:
+            os.unlink(f.name)
+
+    def test_tokens_match_strtod(self):
+        # float() rounds correctly, like strtod; CRLF line ends and blank lines in between
+        rows = [self.TOKENS[i:i + 3] for i in range(0, len(self.TOKENS) - 2, 3)]
+        text = "\r\n".join(",".join(row) for row in rows[:3]) + "\r\n\r\n\n" + "\n".join(",".join(row) for row in rows[3:]) + "\n"
+        expected = np.array([[float(token) for token in row] for row in rows], dtype=symnmf_capi.dtype)
+        np.testing.assert_array_equal(self.load(text), expected)
+
+    def test_many_chunks(self):
+        # more than one 4 MiB chunk, so the rows of several chunks are placed one after the other
+        X = np.random.default_rng(0).standard_normal((120000, 5))
+        text = "\n".join(",".join(repr(float(value)) for value in row) for row in X) + "\n"
+        self.assertGreater(len(text), 2 * (1 << 22))
+        np.testing.assert_array_equal(self.load(text), X.astype(symnmf_capi.dtype))
+
+
+class MatrixTest(unittest.TestCase):
+    def test_results_are_c_contiguous(self):
+        X = gaussian_blobs(3, 17, d=3)
+        n, d = X.shape
+        for result in (symnmf_capi.fit(X, n, d, 3, 0), symnmf_capi.norm(X, n, d), symnmf_capi.ddg(X, n, d)):
+            array = np.asarray(result)
+            self.assertTrue(array.flags["C_CONTIGUOUS"])
+            self.assertEqual(array.strides, (array.shape[1] * array.itemsize, array.itemsize))
+        # the compacted rows are still the rows
+        A = np.asarray(symnmf_capi.sym(X, n, d))
+        expected = np.exp(-np.sum((X[:, None, :] - X[None, :, :]) ** 2, axis=2) / 2)
+        np.fill_diagonal(expected, 0)
+        np.testing.assert_allclose(A, expected, rtol=1e-12, atol=1e-300)
+        self.assertIs(np.ascontiguousarray(A), A)
+
+
+class StreamTest(unittest.TestCase):
+    def test_isolated_point_stays_finite(self):
+        X = gaussian_blobs(2, 15, d=3)
+        X[7] += 1000.0  # no similarity to any other point
+        stream = symnmf_capi.Stream(3, 2, 0)
+        stream.append(X, len(X))
+        H, report = stream.fit()
+        self.assertTrue(np.isfinite(np.asarray(H)).all())
+        self.assertTrue(np.isfinite(report["residual"]))
+
+
+class SparseTest(unittest.TestCase):
+    def test_isolated_point_stays_finite(self):
+        X = np.vstack([gaussian_blobs(3, 100, d=4), np.full((1, 4), 100.0)])
+        n, d, k = X.shape[0], X.shape[1], 3
+        indptr, indices, data = symnmf_capi.knn_norm(X, n, d, 5, 0.0)
+        self.assertTrue(np.isfinite(data).all())
+        self.assertEqual(indptr[n], indptr[n - 1])  # the outlier has no neighbors
+        H0 = np.random.default_rng(0).uniform(0, 0.5, (n, k))
+        H = np.asarray(symnmf_capi.symnmf_knn(indptr, indices, data, H0, n, k))
+        self.assertTrue(np.isfinite(H).all())
+
+
+class SweepTest(unittest.TestCase):
+    def best_k(self, X, k_min, k_max):
+        results = symnmf_capi.sweep(X, len(X), X.shape[1], k_min, k_max, 0)
+        return max(results, key=lambda result: result[1]["score"])[1]["k"]
+
+    def test_picks_planted_k(self):
+        for seed in range(3):
+            X = gaussian_blobs(3, 60, spread=1.0, distance=6.0, seed=seed)
+            self.assertEqual(self.best_k(X, 2, 5), 3)
+
+    def test_split_keeps_separated_clusters(self):
+        # the warm start of k = 3 used to cut one of the three clusters and keep two of them merged
+        X = gaussian_blobs(3, 60, spread=0.3, distance=10.0)
+        n, d = X.shape
+        results = symnmf_capi.sweep(X, n, d, 2, 4, 0)
+        H, report = results[1]
+        sizes = np.bincount(np.argmax(np.asarray(H), axis=1), minlength=3)
+        self.assertEqual(sorted(sizes.tolist()), [60, 60, 60])
+        self.assertEqual(self.best_k(X, 2, 4), 3)
+
+    def test_warm_starts_by_default(self):
+        X = gaussian_blobs(3, 60, spread=1.0, distance=6.0)
+        results = symnmf_capi.sweep(X, len(X), X.shape[1], 2, 5, 0)
+        self.assertEqual([report["warm_started"] for H, report in results], [False, True, True, True])
+
+    def test_cold_starts_never_worse_than_cold_start(self):
+        X = gaussian_blobs(3, 60, spread=0.3, distance=10.0, seed=1)
+        n, d = X.shape
+        W = np.asarray(symnmf_capi.norm(X, n, d))
+        for H, report in symnmf_capi.sweep(X, n, d, 2, 5, 0, cold_starts=True):
+            cold = np.asarray(symnmf_capi.fit(X, n, d, report["k"], 0))
+            self.assertLessEqual(report["residual"], np.sum((W - cold @ cold.T) ** 2) * (1 + 1e-9))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,69 @@
+""" Tests of the K-means of the analysis (kmeans.c) against the loop of kmeans.py (make test) """
+import unittest
+import numpy as np
+import symnmf_capi
+from kmeans import Cluster, DataPoint
+from test_capi import gaussian_blobs
+
+EPSILON = 0.0001
+MAX_ITER = 300
+
+
+def baseline_kmeans(X, k):
+    # The K-means loop of the analysis before kmeans.c: the first k points are the initial centroids
+    data_points = [DataPoint([float(v) for v in row], i) for i, row in enumerate(X)]
+    clusters = []
+    for i in range(k):
+        cluster = Cluster(data_points[i])
+        data_points[i].cluster = cluster
+        clusters.append(cluster)
+    i = 0
+    convergence = False
+    while (not convergence) and (i < MAX_ITER):
+        for point in data_points:
+            point.assign_to_closest(clusters)
+        convergence = True
+        for cluster in clusters:
+            delta = cluster.update_centroid()
+            if delta >= EPSILON:
+                convergence = False
+        i += 1
+    labels = [0] * len(data_points)
+    for index, cluster in enumerate(clusters):
+        for point in cluster.points:
+            labels[point.initial_index] = index
+    return labels, i
+
+
+class KMeansTest(unittest.TestCase):
+    def assert_matches_baseline(self, X, k):
+        n, d = X.shape
+        labels, centroids, iterations = symnmf_capi.kmeans(X, n, d, k)
+        expected_labels, expected_iterations = baseline_kmeans(X, k)
+        self.assertEqual(list(labels), expected_labels)
+        self.assertEqual(iterations, expected_iterations)
+
+    def test_blobs_match_baseline(self):
+        for seed in range(10):
+            rng = np.random.default_rng(seed)
+            k = int(rng.integers(2, 7))
+            d = int(rng.integers(2, 6))
+            # shuffled, so the first k points (the initial centroids) come from any of the clusters
+            X = rng.permutation(gaussian_blobs(k, int(rng.integers(10, 40)), d=d, spread=1.5, distance=4.0, seed=seed))
+            with self.subTest(seed=seed, k=k, d=d):
+                self.assert_matches_baseline(np.ascontiguousarray(X), k)
+
+    def test_uniform_points_match_baseline(self):
+        # no cluster structure: many iterations and points that move between close centroids
+        for seed in range(10):
+            rng = np.random.default_rng(100 + seed)
+            n = int(rng.integers(30, 300))
+            d = int(rng.integers(1, 8))
+            k = int(rng.integers(2, 11))
+            X = rng.random((n, d))
+            with self.subTest(seed=seed, n=n, d=d, k=k):
+                self.assert_matches_baseline(X, k)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,35 @@
+""" Tests of the Python interface (symnmf.py, make test) """
+import unittest
+import numpy as np
+import symnmf_capi
+import symnmf
+from test_capi import gaussian_blobs
+
+
+class HelpersTest(unittest.TestCase):
+    def setUp(self):
+        self.X = gaussian_blobs(3, 20, d=3)
+        self.n, self.d, self.k = self.X.shape[0], self.X.shape[1], 3
+
+    def test_initialize_h_finds_the_clusters(self):
+        W, H0 = symnmf.initialize_h(self.X, self.n, self.k, self.d)
+        self.assertEqual(H0.shape, (self.n, self.k))
+        np.testing.assert_allclose(np.asarray(W), np.asarray(symnmf_capi.norm(self.X, self.n, self.d)))
+        labels = np.argmax(np.asarray(symnmf_capi.symnmf(W, H0, self.n, self.k)), axis=1)
+        self.assertEqual(sorted(np.bincount(labels).tolist()), [20, 20, 20])
+
+    def test_restarts_no_worse_than_one_run(self):
+        W = np.asarray(symnmf_capi.norm(self.X, self.n, self.d))
+        one = np.asarray(symnmf_capi.fit(self.X, self.n, self.d, self.k, 0))
+        best = np.asarray(symnmf.symnmf_restarts(self.X, self.n, self.k, self.d, 4))
+        self.assertLessEqual(np.sum((W - best @ best.T) ** 2), np.sum((W - one @ one.T) ** 2) * (1 + 1e-9))
+
+    def test_knn_finds_the_clusters(self):
+        H = np.asarray(symnmf.symnmf_knn(self.X, self.n, self.k, self.d, 5))
+        self.assertEqual(H.shape, (self.n, self.k))
+        labels = np.argmax(H, axis=1)
+        self.assertEqual(sorted(np.bincount(labels, minlength=3).tolist()), [20, 20, 20])
+
+
+if __name__ == "__main__":
+    unittest.main()